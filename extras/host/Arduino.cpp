@@ -0,0 +1,83 @@
+/**
+ * @file Arduino.cpp
+ * @brief Minimal Arduino API for host builds (Linux) of the xy6020l library
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#include "Arduino.h"
+#include <time.h>
+
+HostConsole Serial;
+
+static unsigned long long monotonicUs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/** @brief program start, time base of millis() and micros() */
+static unsigned long long gStartUs = monotonicUs();
+
+static unsigned long long nowUs(void)
+{
+  return monotonicUs() - gStartUs;
+}
+
+unsigned long millis(void)
+{
+  return (unsigned long)( nowUs() / 1000 );
+}
+
+unsigned long micros(void)
+{
+  return (unsigned long)nowUs();
+}
+
+void delay(unsigned long ms)
+{
+  struct timespec ts;
+  ts.tv_sec = ms / 1000;
+  ts.tv_nsec = (ms % 1000) * 1000000L;
+  nanosleep(&ts, nullptr);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  struct timespec ts;
+  ts.tv_sec = us / 1000000;
+  ts.tv_nsec = (us % 1000000) * 1000L;
+  nanosleep(&ts, nullptr);
+}
+
+size_t Print::write(const uint8_t* pBuf, size_t size)
+{
+  size_t n = 0;
+  while( size-- )
+    n += write(*pBuf++);
+  return n;
+}
+
+size_t Print::print(long v)
+{
+  char tmpBuf[24];
+  snprintf(tmpBuf, sizeof(tmpBuf), "%ld", v);
+  return print(tmpBuf);
+}
+
+size_t Print::print(unsigned long v)
+{
+  char tmpBuf[24];
+  snprintf(tmpBuf, sizeof(tmpBuf), "%lu", v);
+  return print(tmpBuf);
+}
+
+size_t Print::print(double v)
+{
+  char tmpBuf[32];
+  snprintf(tmpBuf, sizeof(tmpBuf), "%.2f", v);
+  return print(tmpBuf);
+}
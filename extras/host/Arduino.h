@@ -0,0 +1,80 @@
+/**
+ * @file Arduino.h
+ * @brief Minimal Arduino API for host builds (Linux) of the xy6020l library
+ *
+ * Provides the types and functions the library uses, so the sources in src/ compile unchanged on a Linux host.
+ * The serial port of the XY6020L is provided by HostSerial.
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t  byte;
+typedef uint16_t word;
+typedef bool     boolean;
+
+// no separate flash address space on the host
+#define PROGMEM
+#define memcpy_P memcpy
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define pgm_read_word(p) (*(const uint16_t*)(p))
+class __FlashStringHelper;
+#define F(s) ((const __FlashStringHelper*)(s))
+
+/** @brief time since program start */
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+class Print
+{
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* pBuf, size_t size);
+    virtual void flush(void) {}
+
+    size_t print(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+    size_t print(const __FlashStringHelper* s) { return print((const char*)s); }
+    size_t print(long v);
+    size_t print(unsigned long v);
+    size_t print(int v) { return print((long)v); }
+    size_t print(unsigned int v) { return print((unsigned long)v); }
+    size_t print(double v);
+    template <typename T> size_t println(T v) { size_t n = print(v); return n + print("\n"); }
+};
+
+class Stream : public Print
+{
+  public:
+    virtual int available(void) = 0;
+    virtual int read(void) = 0;
+    virtual int peek(void) = 0;
+};
+
+/** @brief debug output to stdout */
+class HostConsole : public Stream
+{
+  public:
+    void begin(unsigned long) {}
+    int available(void) { return 0; }
+    int read(void) { return -1; }
+    int peek(void) { return -1; }
+    size_t write(uint8_t c) { return fwrite(&c, 1, 1, stdout); }
+    size_t write(const uint8_t* pBuf, size_t size) { return fwrite(pBuf, 1, size, stdout); }
+    void flush(void) { fflush(stdout); }
+};
+extern HostConsole Serial;
+
+#endif
@@ -0,0 +1,32 @@
+/**
+ * @file HostFile.h
+ * @brief Print into a file for host builds, i.e. as log of xyRecordStream
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef HostFile_h
+#define HostFile_h
+
+#include "Arduino.h"
+
+class HostFile : public Print
+{
+  public:
+    HostFile() { mFile = nullptr; };
+    ~HostFile() { close(); };
+    /** @param mode fopen mode, i.e. "wb" or "ab" */
+    bool open(const char* fileName, const char* mode="wb") { close(); mFile = fopen(fileName, mode); return mFile != nullptr; };
+    void close(void) { if( mFile != nullptr ) fclose(mFile); mFile = nullptr; };
+    bool isOpen(void) { return mFile != nullptr; };
+
+    size_t write(uint8_t c) { return mFile != nullptr ? fwrite(&c, 1, 1, mFile) : 0; };
+    size_t write(const uint8_t* pBuf, size_t size) { return mFile != nullptr ? fwrite(pBuf, 1, size, mFile) : 0; };
+    void flush(void) { if( mFile != nullptr ) fflush(mFile); };
+
+  private:
+    FILE* mFile;
+};
+#endif
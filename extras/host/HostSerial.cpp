@@ -0,0 +1,138 @@
+/**
+ * @file HostSerial.cpp
+ * @brief Stream on a Linux serial port for host builds of the xy6020l library
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#include "HostSerial.h"
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <errno.h>
+
+HostSerial::HostSerial(const char* device)
+{
+  mDevice = device;
+  mFd = -1;
+  mRxHead = 0;
+  mRxTail = 0;
+}
+
+HostSerial::~HostSerial()
+{
+  end();
+}
+
+static speed_t toSpeed(unsigned long baud)
+{
+  switch(baud)
+  {
+    case 2400:   return B2400;
+    case 4800:   return B4800;
+    case 9600:   return B9600;
+    case 19200:  return B19200;
+    case 38400:  return B38400;
+    case 57600:  return B57600;
+    case 115200: return B115200;
+    // 14400 and 56000 have no termios constant
+    default:     return B0;
+  }
+}
+
+bool HostSerial::begin(unsigned long baud)
+{
+  struct termios tio;
+  speed_t speed = toSpeed(baud);
+
+  if( speed == B0 )
+    return false;
+  if( mFd < 0 )
+  {
+    mFd = open(mDevice, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if( mFd < 0 )
+      return false;
+  }
+  if( tcgetattr(mFd, &tio) != 0 )
+    return false;
+  cfmakeraw(&tio);
+  tio.c_cflag |= CLOCAL | CREAD;
+  tio.c_cflag &= ~(CSTOPB | PARENB);
+  cfsetispeed(&tio, speed);
+  cfsetospeed(&tio, speed);
+  if( tcsetattr(mFd, TCSANOW, &tio) != 0 )
+    return false;
+  tcflush(mFd, TCIOFLUSH);
+  mRxHead = mRxTail = 0;
+  return true;
+}
+
+void HostSerial::end(void)
+{
+  if( mFd >= 0 )
+    close(mFd);
+  mFd = -1;
+}
+
+void HostSerial::fill(void)
+{
+  ssize_t n;
+  if( mFd < 0 )
+    return;
+  if( mRxHead == mRxTail )
+    mRxHead = mRxTail = 0;
+  if( mRxTail < HOST_SERIAL_RX_BUFFER_SIZE )
+  {
+    n = ::read(mFd, &mRxBuf[mRxTail], HOST_SERIAL_RX_BUFFER_SIZE - mRxTail);
+    if( n > 0 )
+      mRxTail += n;
+  }
+}
+
+int HostSerial::available(void)
+{
+  fill();
+  return mRxTail - mRxHead;
+}
+
+int HostSerial::read(void)
+{
+  if( available() <= 0 )
+    return -1;
+  return mRxBuf[mRxHead++];
+}
+
+int HostSerial::peek(void)
+{
+  if( available() <= 0 )
+    return -1;
+  return mRxBuf[mRxHead];
+}
+
+size_t HostSerial::write(const uint8_t* pBuf, size_t size)
+{
+  ssize_t n;
+  size_t done = 0;
+  if( mFd < 0 )
+    return 0;
+  while( done < size )
+  {
+    n = ::write(mFd, pBuf + done, size - done);
+    if( n > 0 )
+      done += n;
+    else if( n < 0 && errno != EAGAIN )
+      break;
+    else
+      // tx queue of the tty full
+      usleep(100);
+  }
+  return done;
+}
+
+void HostSerial::flush(void)
+{
+  if( mFd >= 0 )
+    tcdrain(mFd);
+}
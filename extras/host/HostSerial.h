@@ -0,0 +1,47 @@
+/**
+ * @file HostSerial.h
+ * @brief Stream on a Linux serial port (i.e. USB-UART adapter) for host builds of the xy6020l library
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef HostSerial_h
+#define HostSerial_h
+
+#include "Arduino.h"
+
+#define HOST_SERIAL_RX_BUFFER_SIZE 256
+
+class HostSerial : public Stream
+{
+  public:
+    /** @param device path of the tty, i.e. /dev/ttyUSB0 */
+    HostSerial(const char* device);
+    ~HostSerial();
+    /** @brief opens the port or changes its baud rate, 8N1, raw mode
+        @return false if the port could not be opened or the rate is unsupported */
+    bool begin(unsigned long baud);
+    void end(void);
+    bool isOpen(void) { return mFd >= 0; };
+
+    int available(void);
+    int read(void);
+    int peek(void);
+    size_t write(uint8_t c) { return write(&c, 1); };
+    size_t write(const uint8_t* pBuf, size_t size);
+    /** @brief waits till all bytes are transmitted */
+    void flush(void);
+
+  private:
+    const char*   mDevice;
+    int           mFd;
+    /** @brief bytes read from the tty, but not consumed yet */
+    unsigned char mRxBuf[HOST_SERIAL_RX_BUFFER_SIZE];
+    int           mRxHead;
+    int           mRxTail;
+
+    void fill(void);
+};
+#endif
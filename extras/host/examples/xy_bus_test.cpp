@@ -0,0 +1,136 @@
+/**
+ * @file xy_bus_test.cpp
+ * @brief Test of bus discovery and baud rate change on the simulated bus
+ *
+ * Scans 3 units at 9600 baud and moves them to 115200 baud with different behaviour of unit 2 or 3:
+ * all move, one refuses the new rate (all units back at 9600), the acknowledge of one is lost (all move),
+ * one applies the rate after a reset only (reported, no rollback). A rescan of all rates checks where the units really are.
+ * An address found at 2 rates is listed once as conflict and MoveAll() refuses to run.
+ *
+ * Usage: xy_bus_test
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#include "Arduino.h"
+#include "xy6020l.h"
+#include "xy6020l_bus.h"
+#include "xy6020l_clock.h"
+#include "xySimBus.h"
+
+/** @brief virtual time between 2 calls of task(), in us */
+#define TEST_TICK 100
+
+static xySimBus* gpBus = nullptr;
+static bool gOk = true;
+
+static void setBaud(unsigned long baud)
+{
+  gpBus->setBaud(baud);
+}
+
+static void check(bool cond, const char* what)
+{
+  printf("  %s: %s\n", what, cond ? "ok" : "FAIL");
+  if( !cond )
+    gOk = false;
+}
+
+static void run(xyBus& bus, xyVirtualClock& clock)
+{
+  while( bus.task() )
+    clock.advance(TEST_TICK);
+}
+
+/** @brief scans all rates, true if the units 1..3 are found once each at baud */
+static bool rescan(xyBus& bus, xyVirtualClock& clock, byte baud)
+{
+  bool ok;
+
+  bus.Scan(1, 4);
+  run(bus, clock);
+  ok = bus.getNbUnits() == 3;
+  for(byte i=0; ok && i < 3; i++)
+    ok = bus.getUnit(i)->Adr == i + 1 && bus.getUnit(i)->Baud == baud && !bus.getUnit(i)->Conflict;
+  return ok;
+}
+
+/** @brief moves 3 units from 9600 to 115200 baud, unit failAdr with mode */
+static void move(const char* name, byte failAdr, tSimBaudMode mode)
+{
+  xyVirtualClock clock(4294967296ULL - 10000000ULL);
+  xySimBus sim(clock, 9600);
+  xyBus bus(sim, setBaud, 50, &clock);
+  tXyUnit* pUnit;
+  byte nbFailed = 0, nbPending = 0;
+
+  gpBus = &sim;
+  for(byte adr=1; adr <= 3; adr++)
+    sim.addUnit(adr);
+  sim.setBaudMode(failAdr, mode);
+
+  printf("%s\n", name);
+  bus.Scan(1, 4, 1 << XY_BAUD_9600);
+  run(bus, clock);
+  check(bus.getNbUnits() == 3, "scan");
+  check(bus.MoveAll(XY_BAUD_115200), "move started");
+  run(bus, clock);
+  for(byte i=0; i < bus.getNbUnits(); i++)
+  {
+    pUnit = bus.getUnit(i);
+    nbFailed += pUnit->MoveFailed ? 1 : 0;
+    nbPending += pUnit->MovePending ? 1 : 0;
+  }
+
+  switch( mode )
+  {
+    case XY_SIM_BAUD_REFUSE:
+      check(nbFailed == 1 && bus.getUnit(failAdr - 1)->MoveFailed && nbPending == 0, "one failed");
+      check(bus.getBaud() == XY_BAUD_9600, "UART back at 9600");
+      check(rescan(bus, clock, XY_BAUD_9600), "all units back at 9600");
+      break;
+    case XY_SIM_BAUD_AFTER_RESET:
+      check(nbFailed == 0 && nbPending == 1 && bus.getUnit(failAdr - 1)->MovePending, "one pending, no rollback");
+      check(bus.getBaud() == XY_BAUD_115200, "UART at 115200");
+      sim.resetUnit(failAdr);
+      check(rescan(bus, clock, XY_BAUD_115200), "all units at 115200 after reset");
+      break;
+    default:
+      check(nbFailed == 0 && nbPending == 0, "all moved");
+      check(bus.getBaud() == XY_BAUD_115200, "UART at 115200");
+      check(rescan(bus, clock, XY_BAUD_115200), "all units at 115200");
+      break;
+  }
+}
+
+static void conflict(void)
+{
+  xyVirtualClock clock;
+  xySimBus sim(clock, 9600);
+  xyBus bus(sim, setBaud, 50, &clock);
+
+  gpBus = &sim;
+  sim.addUnit(1);
+  sim.addUnit(2, XY_BAUD_9600);
+  sim.addUnit(2, XY_BAUD_115200);
+
+  printf("address conflict\n");
+  bus.Scan(1, 3);
+  run(bus, clock);
+  check(bus.getNbUnits() == 2 && !bus.getUnit(0)->Conflict && bus.getUnit(1)->Adr == 2 && bus.getUnit(1)->Conflict,
+        "address 2 listed once as conflict");
+  check(!bus.MoveAll(XY_BAUD_115200), "move refused");
+}
+
+int main(void)
+{
+  move("all units move", 2, XY_SIM_BAUD_NOW);
+  move("unit 3 refuses the rate", 3, XY_SIM_BAUD_REFUSE);
+  move("acknowledge of unit 2 lost", 2, XY_SIM_BAUD_NO_ACK);
+  move("unit 2 applies the rate after reset", 2, XY_SIM_BAUD_AFTER_RESET);
+  conflict();
+  printf(gOk ? "PASS\n" : "FAIL\n");
+  return gOk ? 0 : 1;
+}
@@ -0,0 +1,97 @@
+/**
+ * @file xy_energy_test.cpp
+ * @brief Test of the charge/energy integration of xyEnergy on the simulated bus
+ *
+ * Runs one unit at 12 V / 2 A for 10 simulated minutes with 0, 1 and 5 resets of its charge/energy counters
+ * and checks that each reset is detected and that the exact charge and energy of the simulation lie
+ * within getAh() +- getAhErr() and getWh() +- getWhErr().
+ *
+ * Usage: xy_energy_test
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#include "Arduino.h"
+#include "xy6020l.h"
+#include "xy6020l_clock.h"
+#include "xy6020l_energy.h"
+#include "xySimBus.h"
+#include <math.h>
+
+/** @brief virtual time between 2 calls of task(), in us */
+#define TEST_TICK 100
+/** @brief simulated run time and time between counter resets, in us */
+#define TEST_RUN 600000000ULL
+#define TEST_RESET_PERIOD 100000000ULL
+
+static bool gOk = true;
+
+static void check(bool cond, const char* what)
+{
+  printf("  %s: %s\n", what, cond ? "ok" : "FAIL");
+  if( !cond )
+    gOk = false;
+}
+
+static void run(word nbResets)
+{
+  xyVirtualClock clock(4294967296ULL - 10000000ULL);
+  xySimBus bus(clock);
+  bus.addUnit(1);
+  xy6020l xy(bus, 1, 50, XY6020_OPT_SKIP_SAME_HREG_VALUE, &clock);
+  xyEnergy energy(xy);
+  unsigned long long tStart = 0, tReset = 0;
+  double q0 = 0, e0 = 0, q, e;
+  word resets = 0;
+  bool started = false;
+
+  xy.setCV(1200);
+  xy.setCC(400);
+  xy.setOutput(true);
+  while( !started || clock.get() - tStart < TEST_RUN )
+  {
+    xy.task();
+    if( xy.HRegUpdated() )
+    {
+      // integration starts with the first sample of the running output
+      if( !started && xy.HRegValid() && xy.getOutputOn() && xy.getActC() > 0 )
+      {
+        started = true;
+        energy.Reset();
+        tStart = clock.get();
+        tReset = tStart + TEST_RESET_PERIOD;
+        q0 = bus.getCharge(1);
+        e0 = bus.getEnergy(1);
+      }
+      if( started )
+        energy.Update();
+    }
+    if( started && resets < nbResets && clock.get() >= tReset )
+    {
+      bus.resetCounters(1);
+      resets++;
+      tReset += TEST_RESET_PERIOD;
+    }
+    clock.advance(TEST_TICK);
+  }
+  energy.Update();
+
+  q = (bus.getCharge(1) - q0) * 0.001;
+  e = (bus.getEnergy(1) - e0) * 0.001;
+  printf("%u counter resets: %.6f +- %.6f Ah (exact %.6f), %.6f +- %.6f Wh (exact %.6f)\n", nbResets,
+         energy.getAh(), energy.getAhErr(), q, energy.getWh(), energy.getWhErr(), e);
+  check(energy.getCntResets() == nbResets, "resets detected");
+  check(fabs(energy.getAh() - q) <= energy.getAhErr() + 1e-6, "charge within error bound");
+  check(fabs(energy.getWh() - e) <= energy.getWhErr() + 1e-6, "energy within error bound");
+}
+
+int main(void)
+{
+  run(0);
+  run(1);
+  run(5);
+  printf(gOk ? "PASS\n" : "FAIL\n");
+  return gOk ? 0 : 1;
+}
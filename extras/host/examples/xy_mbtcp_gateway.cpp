@@ -0,0 +1,48 @@
+/**
+ * @file xy_mbtcp_gateway.cpp
+ * @brief Modbus TCP gateway for one XY6020L at a USB-UART adapter
+ *
+ * Usage: xy_mbtcp_gateway [tty] [baud] [port]
+ *   defaults: /dev/ttyUSB0 115200 1502
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#include "Arduino.h"
+#include "HostSerial.h"
+#include "xy6020l.h"
+#include "xyModbusTcp.h"
+#include <unistd.h>
+
+int main(int argc, char* argv[])
+{
+  const char* device = argc > 1 ? argv[1] : "/dev/ttyUSB0";
+  unsigned long baud = argc > 2 ? strtoul(argv[2], nullptr, 10) : 115200;
+  word port = argc > 3 ? (word)atoi(argv[3]) : 1502;
+
+  HostSerial serial(device);
+  if( !serial.begin(baud) )
+  {
+    fprintf(stderr, "can not open %s\n", device);
+    return 1;
+  }
+  xy6020l xy(serial, 1);
+  xyModbusTcp gateway(500);
+  gateway.addUnit(1, xy);
+  if( !gateway.begin(port) )
+  {
+    fprintf(stderr, "can not listen at port %u\n", port);
+    return 1;
+  }
+  printf("Modbus TCP gateway at port %u\n", gateway.getPort());
+
+  for(;;)
+  {
+    xy.task();
+    gateway.task();
+    usleep(200);
+  }
+  return 0;
+}
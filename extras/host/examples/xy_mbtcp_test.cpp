@@ -0,0 +1,196 @@
+/**
+ * @file xy_mbtcp_test.cpp
+ * @brief Loopback test of the Modbus TCP gateway in front of a simulated XY6020L
+ *
+ * Binds the gateway to 127.0.0.1 on a free port, connects a client socket and checks one answer each
+ * for FC03, FC06 and FC16, the illegal address exception of the unpolled register 0x1E and the hold back
+ * of reads from a stale cache: answered after the next update, exception 0x0B without update.
+ * The driver and the simulated bus run on a xyVirtualClock, the sockets are real.
+ *
+ * Usage: xy_mbtcp_test
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#include "Arduino.h"
+#include "xy6020l.h"
+#include "xy6020l_clock.h"
+#include "xySimBus.h"
+#include "xyModbusTcp.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+/** @brief virtual time between 2 calls of task(), in us */
+#define TEST_TICK 100
+/** @brief staleness limit of the gateway, in ms */
+#define TEST_MAX_STALE 500
+/** @brief longest virtual wait for an answer, in us */
+#define TEST_WAIT 2000000ULL
+
+typedef struct {
+    xyVirtualClock* pClock;
+    xy6020l*        pXy;
+    xyModbusTcp*    pGw;
+    int             Fd;
+    word            Tid;
+} tTest;
+
+static bool gOk = true;
+
+static void check(bool cond, const char* what)
+{
+  printf("%s: %s\n", what, cond ? "ok" : "FAIL");
+  if( !cond )
+    gOk = false;
+}
+
+/** @brief runs driver and gateway till the virtual time passed */
+static void runFor(tTest& t, unsigned long long us, bool driver=true)
+{
+  unsigned long long end = t.pClock->get() + us;
+  while( t.pClock->get() < end )
+  {
+    if( driver )
+      t.pXy->task();
+    t.pGw->task();
+    t.pClock->advance(TEST_TICK);
+  }
+}
+
+/** @brief sends a request PDU, returns the length of the answer PDU in pAns or -1 on timeout */
+static int request(tTest& t, const unsigned char* pPdu, int len, unsigned char* pAns, bool driver=true)
+{
+  unsigned char buf[XY_MBTCP_FRAME_SIZE];
+  unsigned long long end;
+  int rxLen = 0;
+  ssize_t n;
+
+  t.Tid++;
+  buf[0] = t.Tid >> 8;
+  buf[1] = t.Tid & 0xFF;
+  buf[2] = 0;
+  buf[3] = 0;
+  buf[4] = (len + 1) >> 8;
+  buf[5] = (len + 1) & 0xFF;
+  buf[6] = 1;
+  memcpy(&buf[7], pPdu, len);
+  if( send(t.Fd, buf, 7 + len, MSG_NOSIGNAL) != 7 + len )
+    return -1;
+
+  // gateway first: it sees the cache as it was before the request
+  end = t.pClock->get() + TEST_WAIT;
+  while( t.pClock->get() < end )
+  {
+    t.pGw->task();
+    if( driver )
+      t.pXy->task();
+    t.pClock->advance(TEST_TICK);
+    n = recv(t.Fd, &buf[rxLen], sizeof(buf) - rxLen, MSG_DONTWAIT);
+    if( n > 0 )
+      rxLen += n;
+    if( rxLen >= 7 && rxLen >= 6 + buf[4] * 256 + buf[5] )
+    {
+      if( buf[0] != (t.Tid >> 8) || buf[1] != (t.Tid & 0xFF) || buf[6] != 1 )
+        return -1;
+      memcpy(pAns, &buf[7], rxLen - 7);
+      return rxLen - 7;
+    }
+  }
+  return -1;
+}
+
+static int connectTo(word port)
+{
+  struct sockaddr_in adr;
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+  memset(&adr, 0, sizeof(adr));
+  adr.sin_family = AF_INET;
+  adr.sin_port = htons(port);
+  inet_pton(AF_INET, "127.0.0.1", &adr.sin_addr);
+  if( fd >= 0 && connect(fd, (struct sockaddr*)&adr, sizeof(adr)) != 0 )
+  {
+    close(fd);
+    fd = -1;
+  }
+  return fd;
+}
+
+int main(void)
+{
+  xyVirtualClock clock(4294967296ULL - 10000000ULL);
+  xySimBus bus(clock, 115200, 20000);
+  bus.addUnit(1);
+  xy6020l xy(bus, 1, 50, XY6020_OPT_SKIP_SAME_HREG_VALUE, &clock);
+  xyModbusTcp gw(TEST_MAX_STALE);
+  tTest t;
+  unsigned char pdu[XY_MBTCP_FRAME_SIZE], ans[XY_MBTCP_FRAME_SIZE];
+  unsigned long deferred;
+  int len;
+
+  t.pClock = &clock;
+  t.pXy = &xy;
+  t.pGw = &gw;
+  t.Tid = 0;
+  gw.addUnit(1, xy);
+  if( !gw.begin(0, "127.0.0.1") || gw.getPort() == 0 )
+  {
+    printf("FAIL: cannot bind gateway\n");
+    return 1;
+  }
+  t.Fd = connectTo(gw.getPort());
+  if( t.Fd < 0 )
+  {
+    printf("FAIL: cannot connect to port %u\n", gw.getPort());
+    return 1;
+  }
+  printf("gateway on 127.0.0.1:%u\n", gw.getPort());
+
+  // FC03: CV..CC from the cache, held back till the first answer of the unit
+  pdu[0] = 0x03; pdu[1] = 0; pdu[2] = HREG_IDX_CV; pdu[3] = 0; pdu[4] = 2;
+  len = request(t, pdu, 5, ans);
+  check(len == 6 && ans[0] == 0x03 && ans[1] == 4 && ans[2] * 256 + ans[3] == 500 && ans[4] * 256 + ans[5] == 100,
+        "FC03 read CV/CC");
+
+  // FC06: write CV, the unit gets it with the next tx of the driver
+  pdu[0] = 0x06; pdu[1] = 0; pdu[2] = HREG_IDX_CV; pdu[3] = 1200 >> 8; pdu[4] = 1200 & 0xFF;
+  len = request(t, pdu, 5, ans);
+  runFor(t, 200000);
+  check(len == 5 && memcmp(ans, pdu, 5) == 0 && bus.getRegs(1)[HREG_IDX_CV] == 1200, "FC06 write CV");
+
+  // FC16: write CV and CC
+  pdu[0] = 0x10; pdu[1] = 0; pdu[2] = HREG_IDX_CV; pdu[3] = 0; pdu[4] = 2; pdu[5] = 4;
+  pdu[6] = 1500 >> 8; pdu[7] = 1500 & 0xFF; pdu[8] = 300 >> 8; pdu[9] = 300 & 0xFF;
+  len = request(t, pdu, 10, ans);
+  runFor(t, 300000);
+  check(len == 5 && memcmp(ans, pdu, 5) == 0 && bus.getRegs(1)[HREG_IDX_CV] == 1500 && bus.getRegs(1)[HREG_IDX_CC] == 300,
+        "FC16 write CV/CC");
+
+  // register 0x1E is not polled
+  pdu[0] = 0x03; pdu[1] = 0; pdu[2] = 0x1E; pdu[3] = 0; pdu[4] = 1;
+  len = request(t, pdu, 5, ans);
+  check(len == 2 && ans[0] == 0x83 && ans[1] == 0x02, "FC03 0x1E illegal address");
+
+  // stale cache: driver stopped for 1 s, the read waits for the next update
+  runFor(t, 1000000, false);
+  deferred = gw.getNbDeferred();
+  pdu[0] = 0x03; pdu[1] = 0; pdu[2] = HREG_IDX_CV; pdu[3] = 0; pdu[4] = 1;
+  len = request(t, pdu, 5, ans);
+  check(len == 4 && ans[0] == 0x03 && ans[2] * 256 + ans[3] == 1500 && gw.getNbDeferred() == deferred + 1,
+        "FC03 stale cache held back till update");
+
+  // stale cache without update: exception 0x0B after another staleness period
+  runFor(t, 1000000, false);
+  deferred = gw.getNbDeferred();
+  len = request(t, pdu, 5, ans, false);
+  check(len == 2 && ans[0] == 0x83 && ans[1] == 0x0B && gw.getNbDeferred() == deferred + 1, "FC03 stale cache timeout");
+
+  close(t.Fd);
+  gw.end();
+  printf(gOk ? "PASS\n" : "FAIL\n");
+  return gOk ? 0 : 1;
+}
@@ -0,0 +1,147 @@
+/**
+ * @file xy_profile_test.cpp
+ * @brief Test of the deadline scheduled setpoint profiles of xyProfile on the simulated bus
+ *
+ * Steps: a table of steps with distinct voltages, the time each CV value arrives at the simulated unit
+ * is compared with the target time of its step plus the drift reported by getLastDrift().
+ * Long ramp: a ramp over more than 65535 slots of 50 ms, checks the final CV of the unit, the maximum drift
+ * against 2 transaction cycles and that each slot was either emitted or skipped.
+ *
+ * Usage: xy_profile_test
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#include "Arduino.h"
+#include "xy6020l.h"
+#include "xy6020l_clock.h"
+#include "xy6020l_profile.h"
+#include "xySimBus.h"
+
+/** @brief virtual time between 2 calls of task(), in us */
+#define TEST_TICK 100
+/** @brief allowed difference between the reported drift and the arrival at the unit, in ms */
+#define TEST_DRIFT_TOL 2
+/** @brief slot period and duration of the long ramp, in ms: 72000 slots */
+#define TEST_RAMP_SLOT 50
+#define TEST_RAMP_TIME 3600000UL
+
+static bool gOk = true;
+
+static void check(bool cond, const char* what)
+{
+  printf("  %s: %s\n", what, cond ? "ok" : "FAIL");
+  if( !cond )
+    gOk = false;
+}
+
+static void steps(void)
+{
+  static const tProfileSeg segs[] = {
+    { XY_SEG_STEP, XY_SEG_OUT_ON | XY_SEG_SET_CC, 600, 200, 1000 },
+    { XY_SEG_STEP, 0, 700, 0, 1500 },
+    { XY_SEG_STEP, 0, 800, 0, 700 },
+    { XY_SEG_STEP, 0, 900, 0, 1300 },
+    { XY_SEG_STEP, 0, 1000, 0, 1000 },
+  };
+  const byte nbSegs = sizeof(segs) / sizeof(segs[0]);
+  xyVirtualClock clock(4294967296ULL - 2000000ULL);
+  xySimBus bus(clock);
+  bus.addUnit(1);
+  xy6020l xy(bus, 1, 50, XY6020_OPT_SKIP_SAME_HREG_VALUE, &clock);
+  xyProfile profile(xy);
+  unsigned long long tStart, tTarget;
+  long dev, maxDev = 0;
+  word cv, lastCv = 0;
+  byte seen = 0;
+  bool running = true;
+
+  printf("steps\n");
+  // first answer of the unit for the actual CV
+  while( !xy.HRegValid() )
+  {
+    xy.task();
+    clock.advance(TEST_TICK);
+  }
+  profile.Start(segs, nbSegs);
+  tStart = clock.get();
+  // the first step replaces the CV of the unit, its target time is the start
+  tTarget = tStart;
+  while( running || !xy.TxBufEmpty() || seen < nbSegs )
+  {
+    xy.task();
+    running = profile.task();
+    cv = bus.getRegs(1)[HREG_IDX_CV];
+    if( cv != lastCv && lastCv != 0 )
+    {
+      // arrival at the unit - target time of the step vs. reported drift
+      dev = (long)((clock.get() - tTarget) / 1000) - profile.getLastDrift();
+      if( dev < 0 )
+        dev = -dev;
+      if( dev > maxDev )
+        maxDev = dev;
+      printf("  CV %u after %llu ms, target %llu ms, drift %u ms\n", cv, (clock.get() - tStart) / 1000,
+             (tTarget - tStart) / 1000, profile.getLastDrift());
+      check(seen < nbSegs && cv == segs[seen].V, "CV of the step");
+      if( seen < nbSegs )
+        tTarget += segs[seen].Duration * 1000ULL;
+      seen++;
+    }
+    lastCv = cv;
+    if( clock.get() - tStart > 10000000ULL )
+      break;
+    clock.advance(TEST_TICK);
+  }
+  check(seen == nbSegs, "all steps arrived");
+  check(maxDev <= TEST_DRIFT_TOL, "reported drift matches the arrival");
+  check(profile.getEmitted() == nbSegs + 1 && profile.getSkipped() == 0, "all steps emitted");
+}
+
+static void longRamp(void)
+{
+  static const tProfileSeg segs[] = {
+    { XY_SEG_STEP, XY_SEG_OUT_ON, 500, 0, 1000 },
+    { XY_SEG_RAMP, 0, 3000, 0, TEST_RAMP_TIME },
+  };
+  xyVirtualClock clock(4294967296ULL - 2000000ULL);
+  xySimBus bus(clock);
+  bus.addUnit(1);
+  xy6020l xy(bus, 1, 50, XY6020_OPT_SKIP_SAME_HREG_VALUE, &clock);
+  xyProfile profile(xy);
+  unsigned long slots = TEST_RAMP_TIME / TEST_RAMP_SLOT;
+  bool running = true;
+
+  printf("ramp over %lu slots\n", slots);
+  profile.setSlotPeriod(TEST_RAMP_SLOT);
+  profile.Start(segs, 2);
+  while( running || !xy.TxBufEmpty() )
+  {
+    xy.task();
+    running = profile.task();
+    clock.advance(TEST_TICK);
+  }
+  // settle the last write
+  for(word i=0; i < 1000; i++)
+  {
+    xy.task();
+    profile.task();
+    clock.advance(TEST_TICK);
+  }
+  printf("  emitted %lu, skipped %lu, max drift %u ms\n", profile.getEmitted(), profile.getSkipped(), profile.getMaxDrift());
+  check(bus.getRegs(1)[HREG_IDX_CV] == 3000, "final CV");
+  // a setpoint waits at most for the running transaction and the tx period of the next one
+  check(profile.getMaxDrift() <= 2 * (xy.getTxPeriod() + xy.getRtt()), "max drift below 2 transactions");
+  // step + ramp slots + final setpoint
+  check(profile.getEmitted() + profile.getSkipped() >= slots && profile.getEmitted() + profile.getSkipped() <= slots + 2,
+        "each slot emitted or skipped");
+}
+
+int main(void)
+{
+  steps();
+  longRamp();
+  printf(gOk ? "PASS\n" : "FAIL\n");
+  return gOk ? 0 : 1;
+}
@@ -0,0 +1,175 @@
+/**
+ * @file xy_replay_test.cpp
+ * @brief Record and replay round trip of the driver on a simulated bus, runner for recorded corpora
+ *
+ * Without -r: records the traffic of the driver with watchdog and a setpoint change each second against
+ * a simulated XY6020L with answer jitter and late answers for the given number of minutes, then replays
+ * the recording with the same application calls. Fails if a TX frame differs from the recording, the replay stops
+ * before the end of the recording or the driver discards other frames than during the recording.
+ *
+ * With -r: replays recordings of former round trips (i.e. kept from an older library version) with the same
+ * application calls and fails on TX mismatches: regression corpus for decoder and scheduler changes.
+ *
+ * Usage: xy_replay_test [minutes] [file]   default: 60 xy_replay_test.xyrc
+ *        xy_replay_test -r file.xyrc ...
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#include "Arduino.h"
+#include "xy6020l.h"
+#include "xy6020l_clock.h"
+#include "xy6020l_record.h"
+#include "xySimBus.h"
+#include "xyReplay.h"
+#include "HostFile.h"
+#include <time.h>
+
+/** @brief virtual time between 2 calls of task(), in us */
+#define TEST_TICK 100
+/** @brief start 10 s before the wrap around of the 32 bit micros() */
+#define TEST_START (4294967296ULL - 10000000ULL)
+
+/** @brief application part of the loop, the same in recording and replay */
+typedef struct {
+    xyVirtualClock*    pClock;
+    unsigned long long TCv;
+    word               Cv;
+} tTestApp;
+
+static void appLoop(xy6020l& xy, void* pUser)
+{
+  tTestApp* pApp = (tTestApp*)pUser;
+
+  if( pApp->pClock->get() - pApp->TCv >= 1000000ULL )
+  {
+    pApp->TCv = pApp->pClock->get();
+    pApp->Cv = pApp->Cv < 2000 ? pApp->Cv + 10 : 500;
+    xy.setCV(pApp->Cv);
+  }
+}
+
+static void appBegin(xy6020l& xy, xyVirtualClock& clock, tTestApp& app)
+{
+  app.pClock = &clock;
+  app.TCv = clock.get();
+  app.Cv = 500;
+  xy.setWatchdog(200, XY6020_WD_OUTPUT_OFF);
+  xy.setOutput(true);
+}
+
+/** @brief records minutes of traffic, returns the discarded frames of the driver */
+static word record(const char* fileName, unsigned long minutes, unsigned long& nbRecords)
+{
+  xyVirtualClock clock(TEST_START);
+  xySimBus bus(clock, 115200, 20000);
+  HostFile file;
+  tTestApp app;
+
+  bus.addUnit(1);
+  bus.setJitter(20000);
+  // each 500th answer later than the answer timeout
+  bus.setLate(500, 60000);
+  if( !file.open(fileName) )
+    return 0xFFFF;
+  xyRecordStream rec(bus, file, &clock);
+  rec.begin();
+  xy6020l xy(rec, 1, 50, XY6020_OPT_SKIP_SAME_HREG_VALUE, &clock);
+  appBegin(xy, clock, app);
+
+  unsigned long long end = TEST_START + minutes * 60000000ULL;
+  while( clock.get() < end )
+  {
+    xy.task();
+    appLoop(xy, &app);
+    clock.advance(TEST_TICK);
+  }
+  nbRecords = rec.getNbRecords();
+  return xy.getRxDiscarded();
+}
+
+static int roundTrip(unsigned long minutes, const char* fileName)
+{
+  unsigned long nbRecords = 0;
+  word discarded;
+  clock_t c0, c1;
+  bool ok = true;
+
+  discarded = record(fileName, minutes, nbRecords);
+  if( discarded == 0xFFFF )
+  {
+    printf("FAIL: cannot write %s\n", fileName);
+    return 1;
+  }
+
+  xyVirtualClock clock(TEST_START);
+  xyReplayStream replay(clock);
+  tTestApp app;
+  if( !replay.load(fileName) )
+  {
+    printf("FAIL: cannot load %s\n", fileName);
+    return 1;
+  }
+  xy6020l xy(replay, 1, 50, XY6020_OPT_SKIP_SAME_HREG_VALUE, &clock);
+  appBegin(xy, clock, app);
+  c0 = ::clock();
+  replay.run(xy, TEST_TICK, appLoop, &app);
+  c1 = ::clock();
+
+  printf("recorded %lu min, %lu records, replayed in %.2f s cpu\n", minutes, nbRecords, (double)(c1 - c0) / CLOCKS_PER_SEC);
+  printf("tx %lu, mismatch %lu, max deviation %ld us, discarded %u (recording %u)\n",
+         replay.getNbTx(), replay.getNbTxMismatch(), replay.getTxDeviationMax(), xy.getRxDiscarded(), discarded);
+  if( replay.getNbTxMismatch() > 0 || replay.getTxDeviationMax() != 0 )
+  {
+    printf("FAIL: TX differs from recording\n");
+    ok = false;
+  }
+  if( !replay.done() )
+  {
+    printf("FAIL: replay stopped before the end of the recording\n");
+    ok = false;
+  }
+  if( xy.getRxDiscarded() != discarded )
+  {
+    printf("FAIL: discarded frames differ from recording\n");
+    ok = false;
+  }
+  printf(ok ? "PASS\n" : "FAIL\n");
+  return ok ? 0 : 1;
+}
+
+static int corpus(int nbFiles, char* files[])
+{
+  int i, nbFailed = 0;
+
+  for(i=0; i < nbFiles; i++)
+  {
+    xyVirtualClock clock(TEST_START);
+    xyReplayStream replay(clock);
+    if( !replay.load(files[i]) )
+    {
+      printf("%s: FAIL cannot load\n", files[i]);
+      nbFailed++;
+      continue;
+    }
+    tTestApp app;
+    xy6020l xy(replay, 1, 50, XY6020_OPT_SKIP_SAME_HREG_VALUE, &clock);
+    appBegin(xy, clock, app);
+    unsigned long long t = replay.run(xy, TEST_TICK, appLoop, &app);
+    bool ok = replay.getNbTxMismatch() == 0 && replay.done();
+    printf("%s: %llu s, tx %lu, mismatch %lu, max deviation %ld us, discarded %u %s\n", files[i], t / 1000000ULL,
+           replay.getNbTx(), replay.getNbTxMismatch(), replay.getTxDeviationMax(), xy.getRxDiscarded(), ok ? "PASS" : "FAIL");
+    if( !ok )
+      nbFailed++;
+  }
+  return nbFailed > 0 ? 1 : 0;
+}
+
+int main(int argc, char* argv[])
+{
+  if( argc > 1 && strcmp(argv[1], "-r") == 0 )
+    return corpus(argc - 2, &argv[2]);
+  return roundTrip(argc > 1 ? strtoul(argv[1], nullptr, 10) : 60, argc > 2 ? argv[2] : "xy_replay_test.xyrc");
+}
@@ -0,0 +1,95 @@
+/**
+ * @file xy_shm_test.cpp
+ * @brief Test of a restart of the shared memory publisher under a mapped reader
+ *
+ * Publishes a simulated unit, begins a zero copy read and calls begin() of the publisher again:
+ * the read in progress must be invalid after the next publish, the reader sees the new data with a restarted history.
+ * A publisher with another history length replaces the segment: the old reader fails without crash and reopens
+ * with the new layout.
+ *
+ * Usage: xy_shm_test
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#include "Arduino.h"
+#include "xy6020l.h"
+#include "xy6020l_clock.h"
+#include "xySimBus.h"
+#include "xyShm.h"
+#include <unistd.h>
+
+/** @brief virtual time between 2 calls of task(), in us */
+#define TEST_TICK 100
+#define TEST_HIST_LEN 16
+
+static bool gOk = true;
+
+static void check(bool cond, const char* what)
+{
+  printf("%s: %s\n", what, cond ? "ok" : "FAIL");
+  if( !cond )
+    gOk = false;
+}
+
+/** @brief runs the driver till the next HReg update */
+static void update(xy6020l& xy, xyVirtualClock& clock)
+{
+  do
+  {
+    xy.task();
+    clock.advance(TEST_TICK);
+  } while( !xy.HRegUpdated() || !xy.HRegValid() );
+}
+
+int main(void)
+{
+  xyVirtualClock clock;
+  xySimBus bus(clock);
+  bus.addUnit(1);
+  xy6020l xy(bus, 1, 50, XY6020_OPT_SKIP_SAME_HREG_VALUE, &clock);
+  char name[32];
+  tXyShmUnit unit;
+  tXyShmSample hist[TEST_HIST_LEN * 2];
+  uint32_t seq;
+
+  snprintf(name, sizeof(name), "/xy_shm_test_%d", (int)getpid());
+  xyShmPublisher pub(name, 1, TEST_HIST_LEN);
+  xyShmReader reader(name);
+
+  check(pub.begin(), "begin");
+  update(xy, clock);
+  check(pub.publish(0, xy), "publish");
+  check(reader.open() && reader.latest(0, unit) && reader.history(0, hist, TEST_HIST_LEN) == 1, "reader sees the sample");
+
+  // same layout: cleared in place under the mapping of the reader, one publish after the restart
+  // must not give the sequence of the read in progress again
+  check(reader.readBegin(0, seq), "read begun");
+  check(pub.begin(), "begin again");
+  check(!reader.latest(0, unit) && reader.history(0, hist, TEST_HIST_LEN) == 0, "no data after the restart");
+  xy.setCV(1234);
+  update(xy, clock);
+  update(xy, clock);
+  check(pub.publish(0, xy), "publish after the restart");
+  check(!reader.readValid(0, seq), "read begun before the restart is invalid");
+  check(reader.latest(0, unit) && unit.Regs[HREG_IDX_CV] == 1234, "latest shows the new data");
+  check(reader.history(0, hist, TEST_HIST_LEN) == 1, "history restarted");
+
+  // other history length: new segment, the old reader fails and reopens
+  pub.end(false);
+  xyShmPublisher pub2(name, 1, TEST_HIST_LEN * 2);
+  check(pub2.begin(), "begin with another history length");
+  update(xy, clock);
+  pub2.publish(0, xy);
+  check(!reader.readBegin(0, seq) && !reader.latest(0, unit) && reader.history(0, hist, TEST_HIST_LEN) == 0,
+        "old reader fails");
+  check(reader.open() && reader.getHistLen() == TEST_HIST_LEN * 2 && reader.latest(0, unit) &&
+        reader.history(0, hist, TEST_HIST_LEN * 2) == 1, "reopened reader sees the new layout");
+
+  reader.close();
+  pub2.end();
+  printf(gOk ? "PASS\n" : "FAIL\n");
+  return gOk ? 0 : 1;
+}
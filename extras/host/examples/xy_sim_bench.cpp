@@ -0,0 +1,113 @@
+/**
+ * @file xy_sim_bench.cpp
+ * @brief Benchmark and determinism check of the driver on a simulated bus with virtual time
+ *
+ * Runs the driver with status watchdog and a setpoint change each second against a simulated XY6020L
+ * for the given number of hours, twice. The virtual clock starts shortly before 2^32 us, so micros() wraps
+ * around like on the MCU after 71 minutes. Fails if the runs differ or the HReg update stalls.
+ *
+ * Usage: xy_sim_bench [hours]   default: 8
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#include "Arduino.h"
+#include "xy6020l.h"
+#include "xy6020l_clock.h"
+#include "xySimBus.h"
+#include <time.h>
+
+/** @brief virtual time between 2 calls of task(), in us */
+#define BENCH_TICK 100
+/** @brief start 10 s before the wrap around of the 32 bit micros() */
+#define BENCH_START (4294967296ULL - 10000000ULL)
+/** @brief longest allowed time without HReg update, in us */
+#define BENCH_MAX_GAP 1000000ULL
+
+typedef struct {
+    unsigned long Frames;
+    unsigned long Requests;
+    word          Discarded;
+    word          WdTrips;
+    unsigned long long MaxGap;
+    unsigned long long RttSum;
+    word          Regs[NB_HREGS];
+} tBenchResult;
+
+static void run(unsigned long hours, tBenchResult& res)
+{
+  xyVirtualClock clock(BENCH_START);
+  xySimBus bus(clock, 115200, 20000);
+  bus.addUnit(1);
+  bus.setJitter(20000);
+  xy6020l xy(bus, 1, 50, XY6020_OPT_SKIP_SAME_HREG_VALUE, &clock);
+  xy.setWatchdog(200, XY6020_WD_OUTPUT_OFF);
+  unsigned long long end = BENCH_START + hours * 3600000000ULL;
+  unsigned long long tUpdate = clock.get(), tCv = clock.get();
+  word cv = 500;
+
+  memset(&res, 0, sizeof(res));
+  xy.setOutput(true);
+  while( clock.get() < end )
+  {
+    xy.task();
+    if( xy.HRegUpdated() )
+    {
+      res.Frames++;
+      res.RttSum += xy.getRttUs();
+      if( clock.get() - tUpdate > res.MaxGap )
+        res.MaxGap = clock.get() - tUpdate;
+      tUpdate = clock.get();
+    }
+    if( clock.get() - tCv >= 1000000ULL )
+    {
+      tCv = clock.get();
+      cv = cv < 2000 ? cv + 10 : 500;
+      xy.setCV(cv);
+    }
+    clock.advance(BENCH_TICK);
+  }
+  res.Requests = bus.getNbRequests();
+  res.Discarded = xy.getRxDiscarded();
+  res.WdTrips = xy.getWdTrips();
+  for(byte i=0; i < NB_HREGS; i++)
+    res.Regs[i] = xy.getHReg(i);
+}
+
+int main(int argc, char* argv[])
+{
+  unsigned long hours = argc > 1 ? strtoul(argv[1], nullptr, 10) : 8;
+  tBenchResult res1, res2;
+  clock_t c0, c1;
+  bool ok;
+
+  c0 = clock();
+  run(hours, res1);
+  c1 = clock();
+  run(hours, res2);
+
+  printf("simulated %lu h in %.2f s cpu\n", hours, (double)(c1 - c0) / CLOCKS_PER_SEC);
+  printf("frames %lu, requests %lu, discarded %u, max update gap %llu us, avg rtt %llu us\n",
+         res1.Frames, res1.Requests, res1.Discarded, res1.MaxGap, res1.Frames > 0 ? res1.RttSum / res1.Frames : 0);
+
+  ok = true;
+  if( memcmp(&res1, &res2, sizeof(res1)) != 0 )
+  {
+    printf("FAIL: runs differ\n");
+    ok = false;
+  }
+  if( res1.MaxGap > BENCH_MAX_GAP || res1.Frames == 0 )
+  {
+    printf("FAIL: HReg update stalled\n");
+    ok = false;
+  }
+  if( res1.Discarded > 0 || res1.WdTrips > 0 )
+  {
+    printf("FAIL: unexpected discarded frames or watchdog trips\n");
+    ok = false;
+  }
+  printf(ok ? "PASS\n" : "FAIL\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,198 @@
+/**
+ * @file xyLogReader.cpp
+ * @brief Host side reader of the telemetry log written by xyLogWriter
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#include "xyLogReader.h"
+
+#define LOG_HEADER_SIZE 6
+
+xyLogReader::xyLogReader()
+{
+  mpData = nullptr;
+  mSize = 0;
+  mNbRegs = 0;
+  mpKeys = nullptr;
+  mNbKeys = 0;
+  mNbRecords = 0;
+  mTFirst = 0;
+  mTLast = 0;
+}
+
+xyLogReader::~xyLogReader()
+{
+  free(mpData);
+  free(mpKeys);
+}
+
+bool xyLogReader::ReadVarint(size_t& pos, unsigned long& value)
+{
+  byte shift = 0;
+  value = 0;
+  while( pos < mSize && shift < 35 )
+  {
+    value |= (unsigned long)(mpData[pos] & 0x7F) << shift;
+    if( !(mpData[pos++] & 0x80) )
+      return true;
+    shift += 7;
+  }
+  return false;
+}
+
+bool xyLogReader::Decode(size_t& pos, unsigned long long& t, word* pRegs)
+{
+  size_t p = pos;
+  unsigned long value, dt, mask;
+  uint32_t tKey;
+  byte i;
+
+  if( p >= mSize )
+    return false;
+  switch( mpData[p++] )
+  {
+    case XY_LOG_KEY:
+      if( p + 4 > mSize )
+        return false;
+      tKey = (uint32_t)mpData[p] | (uint32_t)mpData[p+1] << 8 | (uint32_t)mpData[p+2] << 16 | (uint32_t)mpData[p+3] << 24;
+      // unwrap: time since the previous record, modulo 2^32
+      t += (uint32_t)(tKey - (uint32_t)t);
+      p += 4;
+      for(i=0; i < mNbRegs; i++)
+      {
+        if( !ReadVarint(p, value) )
+          return false;
+        pRegs[i] = (word)value;
+      }
+      break;
+    case XY_LOG_DELTA:
+      if( !ReadVarint(p, dt) || !ReadVarint(p, mask) )
+        return false;
+      t += dt;
+      for(i=0; i < mNbRegs; i++)
+      {
+        if( mask & (1UL << i) )
+        {
+          if( !ReadVarint(p, value) )
+            return false;
+          // zigzag
+          pRegs[i] += (value & 1) ? (word)(-(long)((value + 1) >> 1)) : (word)(value >> 1);
+        }
+      }
+      break;
+    default:
+      return false;
+  }
+  pos = p;
+  return true;
+}
+
+bool xyLogReader::load(const char* fileName)
+{
+  FILE* pFile;
+  long size;
+  size_t pos, keyPos;
+  unsigned long long t = 0;
+  unsigned long capacity = 0;
+  word regs[XY_LOG_MAX_REGS];
+  tKey* pKeys;
+
+  free(mpData);
+  free(mpKeys);
+  mpData = nullptr;
+  mpKeys = nullptr;
+  mSize = 0;
+  mNbKeys = 0;
+  mNbRecords = 0;
+
+  pFile = fopen(fileName, "rb");
+  if( pFile == nullptr )
+    return false;
+  fseek(pFile, 0, SEEK_END);
+  size = ftell(pFile);
+  fseek(pFile, 0, SEEK_SET);
+  if( size >= LOG_HEADER_SIZE )
+  {
+    mpData = (unsigned char*)malloc(size);
+    if( mpData != nullptr && fread(mpData, 1, size, pFile) == (size_t)size )
+      mSize = size;
+  }
+  fclose(pFile);
+  if( mSize < LOG_HEADER_SIZE || memcmp(mpData, "XYTL", 4) != 0 || mpData[4] != XY_LOG_VERSION ||
+      mpData[5] > XY_LOG_MAX_REGS )
+  {
+    mSize = 0;
+    return false;
+  }
+  mNbRegs = mpData[5];
+
+  // index: one pass over all records, a log has to start with a keyframe
+  pos = LOG_HEADER_SIZE;
+  if( pos < mSize && mpData[pos] != XY_LOG_KEY )
+    return false;
+  while( pos < mSize )
+  {
+    keyPos = pos;
+    if( !Decode(pos, t, regs) )
+      break;
+    if( mpData[keyPos] == XY_LOG_KEY )
+    {
+      if( mNbKeys >= capacity )
+      {
+        capacity = capacity > 0 ? capacity * 2 : 64;
+        pKeys = (tKey*)realloc(mpKeys, capacity * sizeof(tKey));
+        if( pKeys == nullptr )
+          return false;
+        mpKeys = pKeys;
+      }
+      mpKeys[mNbKeys].T = t;
+      mpKeys[mNbKeys].Pos = keyPos;
+      mNbKeys++;
+    }
+    if( mNbRecords == 0 )
+      mTFirst = t;
+    mTLast = t;
+    mNbRecords++;
+  }
+  // ignore truncated last record
+  mSize = pos;
+  return true;
+}
+
+unsigned long xyLogReader::query(unsigned long long tFrom, unsigned long long tTo, tLogFrameCallback cb, void* pUser)
+{
+  unsigned long lo = 0, hi, mid, nb = 0;
+  unsigned long long t;
+  size_t pos;
+  word regs[XY_LOG_MAX_REGS];
+
+  if( mNbKeys == 0 )
+    return 0;
+  // last keyframe with T <= tFrom
+  hi = mNbKeys;
+  while( hi - lo > 1 )
+  {
+    mid = (lo + hi) / 2;
+    if( mpKeys[mid].T <= tFrom )
+      lo = mid;
+    else
+      hi = mid;
+  }
+  pos = mpKeys[lo].Pos;
+  t = mpKeys[lo].T;
+  while( pos < mSize && Decode(pos, t, regs) )
+  {
+    if( t > tTo )
+      break;
+    if( t >= tFrom )
+    {
+      if( cb != nullptr )
+        cb(t, regs, mNbRegs, pUser);
+      nb++;
+    }
+  }
+  return nb;
+}
@@ -0,0 +1,68 @@
+/**
+ * @file xyLogReader.h
+ * @brief Host side reader of the telemetry log written by xyLogWriter
+ *
+ * Loads a log into memory, builds an index of the keyframes and answers time range queries
+ * by decoding from the last keyframe before the range start only.
+ * The 32 bit ms time stamps of the log wrap after 49.7 days, the reader unwraps them to 64 bit:
+ * all times of the reader count on from the first record, keyframes must be less than 49 days apart.
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xyLogReader_h
+#define xyLogReader_h
+
+#include "Arduino.h"
+#include "xy6020l_log.h"
+
+/** @brief max. registers per frame (bitmask width) */
+#define XY_LOG_MAX_REGS 32
+
+/** @brief called for each decoded frame */
+typedef void (*tLogFrameCallback)(unsigned long long t, const word* pRegs, byte nbRegs, void* pUser);
+
+class xyLogReader
+{
+  public:
+    xyLogReader();
+    ~xyLogReader();
+    /** @brief loads log and builds the keyframe index, a truncated last record is ignored */
+    bool load(const char* fileName);
+
+    byte getNbRegs(void) { return mNbRegs; };
+    unsigned long getNbKeyframes(void) { return mNbKeys; };
+    unsigned long getNbRecords(void) { return mNbRecords; };
+    /** @brief time of first and last frame, in ms, unwrapped */
+    unsigned long long getTFirst(void) { return mTFirst; };
+    unsigned long long getTLast(void) { return mTLast; };
+
+    /**
+     * @brief decodes all frames with tFrom <= t <= tTo, unwrapped times as from getTFirst()
+     * @return number of frames passed to cb
+     */
+    unsigned long query(unsigned long long tFrom, unsigned long long tTo, tLogFrameCallback cb, void* pUser=nullptr);
+
+  private:
+    typedef struct {
+        /** @brief unwrapped time */
+        unsigned long long T;
+        size_t        Pos;
+    } tKey;
+
+    unsigned char* mpData;
+    size_t        mSize;
+    byte          mNbRegs;
+    tKey*         mpKeys;
+    unsigned long mNbKeys;
+    unsigned long mNbRecords;
+    unsigned long long mTFirst;
+    unsigned long long mTLast;
+
+    bool ReadVarint(size_t& pos, unsigned long& value);
+    /** @brief decodes the record at pos into t/regs, t: unwrapped time of the previous record before, false if truncated or unknown */
+    bool Decode(size_t& pos, unsigned long long& t, word* pRegs);
+};
+#endif
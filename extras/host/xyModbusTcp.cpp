@@ -0,0 +1,390 @@
+/**
+ * @file xyModbusTcp.cpp
+ * @brief Modbus TCP gateway for XY6020L converters on a Linux host
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#include "xyModbusTcp.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+/** @brief Modbus exception codes */
+#define MB_EX_ILLEGAL_FUNCTION 0x01
+#define MB_EX_ILLEGAL_ADDRESS  0x02
+#define MB_EX_ILLEGAL_VALUE    0x03
+#define MB_EX_BUSY             0x06
+#define MB_EX_TARGET_FAILED    0x0B
+
+xyModbusTcp::xyModbusTcp(word maxStale)
+{
+  mMaxStale = maxStale;
+  mListenFd = -1;
+  mPort = 0;
+  mNbUnits = 0;
+  mNbRequests = 0;
+  mNbDeferred = 0;
+  mNbExceptions = 0;
+  for(int i=0; i < XY_MBTCP_MAX_CLIENTS; i++)
+    mClients[i].Fd = -1;
+}
+
+xyModbusTcp::~xyModbusTcp()
+{
+  end();
+}
+
+bool xyModbusTcp::addUnit(byte unitId, xy6020l& xy)
+{
+  bool retVal=false;
+  if( mNbUnits < XY_MBTCP_MAX_UNITS )
+  {
+    mUnits[mNbUnits].Id = unitId;
+    mUnits[mNbUnits].pXy = &xy;
+    mNbUnits++;
+    retVal = true;
+  }
+  return retVal;
+}
+
+bool xyModbusTcp::begin(word port, const char* bindAdr)
+{
+  struct sockaddr_in adr;
+  socklen_t adrLen = sizeof(adr);
+  int on = 1;
+
+  end();
+  mListenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if( mListenFd < 0 )
+    return false;
+  setsockopt(mListenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  memset(&adr, 0, sizeof(adr));
+  adr.sin_family = AF_INET;
+  adr.sin_port = htons(port);
+  if( inet_pton(AF_INET, bindAdr, &adr.sin_addr) != 1 ||
+      bind(mListenFd, (struct sockaddr*)&adr, sizeof(adr)) != 0 ||
+      listen(mListenFd, XY_MBTCP_MAX_CLIENTS) != 0 ||
+      getsockname(mListenFd, (struct sockaddr*)&adr, &adrLen) != 0 )
+  {
+    end();
+    return false;
+  }
+  mPort = ntohs(adr.sin_port);
+  return true;
+}
+
+void xyModbusTcp::end(void)
+{
+  for(int i=0; i < XY_MBTCP_MAX_CLIENTS; i++)
+    Close(mClients[i]);
+  if( mListenFd >= 0 )
+    close(mListenFd);
+  mListenFd = -1;
+}
+
+void xyModbusTcp::Close(tClient& client)
+{
+  if( client.Fd >= 0 )
+    close(client.Fd);
+  client.Fd = -1;
+}
+
+void xyModbusTcp::Accept(void)
+{
+  int fd, i, on = 1;
+
+  while( (fd = accept4(mListenFd, nullptr, nullptr, SOCK_NONBLOCK)) >= 0 )
+  {
+    for(i=0; i < XY_MBTCP_MAX_CLIENTS; i++)
+    {
+      if( mClients[i].Fd < 0 )
+        break;
+    }
+    if( i >= XY_MBTCP_MAX_CLIENTS )
+    {
+      // no free client slot
+      close(fd);
+      continue;
+    }
+    // answers are small frames, send them at once
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    mClients[i].Fd = fd;
+    mClients[i].RxLen = 0;
+    mClients[i].Pending = false;
+  }
+}
+
+void xyModbusTcp::Receive(tClient& client)
+{
+  ssize_t n;
+
+  if( client.RxLen < XY_MBTCP_FRAME_SIZE )
+  {
+    n = recv(client.Fd, &client.RxBuf[client.RxLen], XY_MBTCP_FRAME_SIZE - client.RxLen, 0);
+    if( n == 0 || ( n < 0 && errno != EAGAIN && errno != EWOULDBLOCK ) )
+    {
+      Close(client);
+      return;
+    }
+    if( n > 0 )
+      client.RxLen += n;
+  }
+}
+
+void xyModbusTcp::task(void)
+{
+  int i;
+
+  if( mListenFd < 0 )
+    return;
+  Accept();
+  for(i=0; i < XY_MBTCP_MAX_CLIENTS; i++)
+  {
+    if( mClients[i].Fd < 0 )
+      continue;
+    // a waiting read blocks the following requests of the same client, Modbus TCP answers in order
+    if( !mClients[i].Pending )
+      Receive(mClients[i]);
+    while( mClients[i].Fd >= 0 && Process(mClients[i]) )
+      ;
+  }
+}
+
+xy6020l* xyModbusTcp::FindUnit(byte unitId)
+{
+  for(byte i=0; i < mNbUnits; i++)
+  {
+    if( mUnits[i].Id == unitId )
+      return mUnits[i].pXy;
+  }
+  if( mNbUnits == 1 && (unitId == 0 || unitId == 255) )
+    return mUnits[0].pXy;
+  return nullptr;
+}
+
+void xyModbusTcp::SendPdu(tClient& client, const unsigned char* pPdu, int len)
+{
+  unsigned char txBuf[XY_MBTCP_FRAME_SIZE];
+
+  // MBAP: transaction id and unit id of the request
+  txBuf[0] = client.RxBuf[0];
+  txBuf[1] = client.RxBuf[1];
+  txBuf[2] = 0;
+  txBuf[3] = 0;
+  txBuf[4] = (len + 1) >> 8;
+  txBuf[5] = (len + 1) & 0xFF;
+  txBuf[6] = client.RxBuf[6];
+  memcpy(&txBuf[7], pPdu, len);
+  if( send(client.Fd, txBuf, 7 + len, MSG_NOSIGNAL) != 7 + len )
+    Close(client);
+}
+
+void xyModbusTcp::SendException(tClient& client, byte fct, byte code)
+{
+  unsigned char pdu[2];
+  pdu[0] = fct | 0x80;
+  pdu[1] = code;
+  mNbExceptions++;
+  SendPdu(client, pdu, 2);
+}
+
+bool xyModbusTcp::ReadRegs(xy6020l* pXy, word start, word cnt, unsigned char* pDst, byte& exception)
+{
+  word i, value;
+  word memStart = HREG_IDX_M0 + pXy->getMemNr() * HREG_IDX_M_OFFSET;
+
+  // cache holds only the polled registers: register 0x1E is not polled; the model (0x16) is
+  if( start + cnt <= NB_HREGS_READ )
+  {
+    for(i=0; i < cnt; i++)
+    {
+      value = pXy->getHReg(start + i);
+      pDst[2*i]   = value >> 8;
+      pDst[2*i+1] = value & 0xFF;
+    }
+    return true;
+  }
+  if( start >= HREG_IDX_M0 && start + cnt <= HREG_IDX_M0 + 10 * HREG_IDX_M_OFFSET )
+  {
+    // memory: only the cached one
+    if( pXy->getMemNr() < 10 && start >= memStart && start + cnt <= memStart + NB_MEMREGS )
+    {
+      for(i=0; i < cnt; i++)
+      {
+        value = pXy->getMemReg(start - memStart + i);
+        pDst[2*i]   = value >> 8;
+        pDst[2*i+1] = value & 0xFF;
+      }
+      return true;
+    }
+    exception = MB_EX_TARGET_FAILED;
+    return false;
+  }
+  exception = MB_EX_ILLEGAL_ADDRESS;
+  return false;
+}
+
+bool xyModbusTcp::WriteRegs(xy6020l* pXy, word start, word cnt, const unsigned char* pSrc, byte& exception)
+{
+  word i, nr;
+  word regs[NB_MEMREGS];
+  tMemory mem;
+
+  if( start + cnt <= NB_HREGS )
+  {
+    if( pXy->getQueueFree() < cnt )
+    {
+      exception = MB_EX_BUSY;
+      return false;
+    }
+    for(i=0; i < cnt; i++)
+      pXy->QueueHReg(start + i, (word)pSrc[2*i] * 256 + pSrc[2*i+1]);
+    return true;
+  }
+  // memory: complete preset at once only
+  nr = (start - HREG_IDX_M0) / HREG_IDX_M_OFFSET;
+  if( start >= HREG_IDX_M0 && nr < 10 && start == HREG_IDX_M0 + nr * HREG_IDX_M_OFFSET && cnt == NB_MEMREGS )
+  {
+    if( pXy->getQueueFree() < 1 )
+    {
+      exception = MB_EX_BUSY;
+      return false;
+    }
+    for(i=0; i < NB_MEMREGS; i++)
+      regs[i] = (word)pSrc[2*i] * 256 + pSrc[2*i+1];
+    mem.Nr   = nr;
+    mem.VSet = regs[HREG_IDX_M_VSET];
+    mem.ISet = regs[HREG_IDX_M_ISET];
+    mem.sLVP = regs[HREG_IDX_M_SLVP];
+    mem.sOVP = regs[HREG_IDX_M_SOVP];
+    mem.sOCP = regs[HREG_IDX_M_SOCP];
+    mem.sOPP = regs[HREG_IDX_M_SOPP];
+    mem.sOHPh= regs[HREG_IDX_M_SOHPH];
+    mem.sOHPm= regs[HREG_IDX_M_SOHPM];
+    mem.sOAH = regs[HREG_IDX_M_SOAHL] | ((unsigned long)regs[HREG_IDX_M_SOAHH])<<16;
+    mem.sOWH = regs[HREG_IDX_M_SOWHL] | ((unsigned long)regs[HREG_IDX_M_SOWHH])<<16;
+    mem.sOTP = regs[HREG_IDX_M_SOTP];
+    mem.sINI = regs[HREG_IDX_M_SINI];
+    pXy->SetMemory(mem);
+    return true;
+  }
+  exception = MB_EX_ILLEGAL_ADDRESS;
+  return false;
+}
+
+bool xyModbusTcp::Process(tClient& client)
+{
+  int len, frameLen, pduLen;
+  unsigned char* pPdu;
+  unsigned char txPdu[XY_MBTCP_FRAME_SIZE];
+  xy6020l* pXy;
+  byte fct, exception = 0;
+  word start, cnt;
+  uint32_t now;
+
+  // MBAP header complete ?
+  if( client.RxLen < 7 )
+    return false;
+  len = (int)client.RxBuf[4] * 256 + client.RxBuf[5];
+  frameLen = 6 + len;
+  if( client.RxBuf[2] != 0 || client.RxBuf[3] != 0 || len < 2 || frameLen > XY_MBTCP_FRAME_SIZE )
+  {
+    // no Modbus TCP
+    Close(client);
+    return false;
+  }
+  if( client.RxLen < frameLen )
+    return false;
+
+  pPdu = &client.RxBuf[7];
+  pduLen = len - 1;
+  fct = pPdu[0];
+  pXy = FindUnit(client.RxBuf[6]);
+
+  if( pXy == nullptr )
+    exception = MB_EX_TARGET_FAILED;
+  else if( (fct == 0x03 || fct == 0x06 || fct == 0x10) && pduLen < 5 )
+    exception = MB_EX_ILLEGAL_VALUE;
+  else
+  {
+    start = (word)pPdu[1] * 256 + pPdu[2];
+    cnt   = (word)pPdu[3] * 256 + pPdu[4];
+    switch( fct )
+    {
+      case 0x03:
+        if( cnt < 1 || cnt > 125 )
+        {
+          exception = MB_EX_ILLEGAL_VALUE;
+          break;
+        }
+        // holding registers too old or not read yet -> wait for next update, max. one more staleness period
+        if( start < NB_HREGS_READ )
+        {
+          now = pXy->getClock().millis();
+          if( !pXy->HRegValid() || now - pXy->getRxTime() > mMaxStale )
+          {
+            if( !client.Pending )
+            {
+              client.Pending = true;
+              client.PendingSince = now;
+              mNbDeferred++;
+              if( pXy->isNoHRegUpdate() )
+                pXy->ReadAllHRegs();
+              return false;
+            }
+            if( now - client.PendingSince <= mMaxStale )
+              return false;
+            exception = MB_EX_TARGET_FAILED;
+            break;
+          }
+        }
+        if( ReadRegs(pXy, start, cnt, &txPdu[2], exception) )
+        {
+          txPdu[0] = fct;
+          txPdu[1] = cnt * 2;
+          SendPdu(client, txPdu, 2 + cnt * 2);
+        }
+        break;
+
+      case 0x06:
+        // cnt is the value
+        if( WriteRegs(pXy, start, 1, &pPdu[3], exception) )
+          SendPdu(client, pPdu, 5);
+        break;
+
+      case 0x10:
+        if( cnt < 1 || cnt > 123 || pduLen < 6 || pPdu[5] != cnt * 2 || pduLen < 6 + cnt * 2 )
+        {
+          exception = MB_EX_ILLEGAL_VALUE;
+          break;
+        }
+        if( WriteRegs(pXy, start, cnt, &pPdu[6], exception) )
+          SendPdu(client, pPdu, 5);
+        break;
+
+      default:
+        exception = MB_EX_ILLEGAL_FUNCTION;
+        break;
+    }
+  }
+  if( exception && client.Fd >= 0 )
+    SendException(client, fct, exception);
+
+  // consume request
+  mNbRequests++;
+  client.Pending = false;
+  if( client.Fd >= 0 )
+  {
+    client.RxLen -= frameLen;
+    memmove(client.RxBuf, &client.RxBuf[frameLen], client.RxLen);
+  }
+  return client.Fd >= 0;
+}
@@ -0,0 +1,103 @@
+/**
+ * @file xyModbusTcp.h
+ * @brief Modbus TCP gateway for XY6020L converters on a Linux host
+ *
+ * Many TCP clients (SCADA, logger, dashboard) share the slow RTU bus of one process:
+ * FC03 reads are answered from the register cache of the xy6020l driver without any RTU traffic,
+ * FC06/FC16 writes are queued into the tx ring buffer of the driver.
+ * A read of data older than the configured staleness is held back till the next cache update.
+ *
+ * Register map (same as XY6020L):
+ *  - 0x00..0x1D holding registers, from the hRegs cache (0x1E is not polled -> illegal address)
+ *    before the first answer of the converter reads are held back like stale data
+ *  - 0x50 + n * 0x10 .. + 13  preset memory n, only the memory in the driver cache (GetMemory/SetMemory)
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xyModbusTcp_h
+#define xyModbusTcp_h
+
+#include "Arduino.h"
+#include "xy6020l.h"
+
+#define XY_MBTCP_MAX_UNITS 8
+#define XY_MBTCP_MAX_CLIENTS 16
+/** @brief MBAP header + max. PDU */
+#define XY_MBTCP_FRAME_SIZE 260
+
+/**
+ * @class xyModbusTcp
+ * @brief Non blocking Modbus TCP server on top of xy6020l drivers
+ */
+class xyModbusTcp
+{
+  public:
+    /** @param maxStale maximum age of cached holding registers for read answers, in ms */
+    xyModbusTcp(word maxStale=500);
+    ~xyModbusTcp();
+
+    /**
+     * @brief maps a Modbus unit id to a driver, with only 1 unit the ids 0 and 255 are accepted too
+     * @return false if table is full
+     */
+    bool addUnit(byte unitId, xy6020l& xy);
+    /**
+     * @brief opens the listening socket
+     * @param port TCP port, 0: any free port, see getPort()
+     * @param bindAdr IPv4 address to bind, i.e. "127.0.0.1" for loopback only
+     */
+    bool begin(word port=502, const char* bindAdr="0.0.0.0");
+    void end(void);
+    /** @brief Task method that must be called in the main loop cyclically, next to xy6020l::task() */
+    void task(void);
+
+    word getPort(void) { return mPort; };
+    /// @name statistics
+    /// @{
+    unsigned long getNbRequests(void) { return mNbRequests; };
+    /** @brief read requests which had to wait for a cache update */
+    unsigned long getNbDeferred(void) { return mNbDeferred; };
+    unsigned long getNbExceptions(void) { return mNbExceptions; };
+    /// @}
+
+  private:
+    typedef struct {
+        int           Fd;
+        unsigned char RxBuf[XY_MBTCP_FRAME_SIZE];
+        int           RxLen;
+        /** @brief read request waiting for fresh data */
+        bool          Pending;
+        uint32_t      PendingSince;
+    } tClient;
+
+    typedef struct {
+        byte     Id;
+        xy6020l* pXy;
+    } tUnit;
+
+    word          mMaxStale;
+    int           mListenFd;
+    word          mPort;
+    tClient       mClients[XY_MBTCP_MAX_CLIENTS];
+    tUnit         mUnits[XY_MBTCP_MAX_UNITS];
+    byte          mNbUnits;
+
+    unsigned long mNbRequests;
+    unsigned long mNbDeferred;
+    unsigned long mNbExceptions;
+
+    void Accept(void);
+    void Receive(tClient& client);
+    void Close(tClient& client);
+    /** @brief processes the frame at begin of the rx buffer, false if it has to wait */
+    bool Process(tClient& client);
+    xy6020l* FindUnit(byte unitId);
+    void SendPdu(tClient& client, const unsigned char* pPdu, int len);
+    void SendException(tClient& client, byte fct, byte code);
+    bool ReadRegs(xy6020l* pXy, word start, word cnt, unsigned char* pDst, byte& exception);
+    bool WriteRegs(xy6020l* pXy, word start, word cnt, const unsigned char* pSrc, byte& exception);
+};
+#endif
@@ -0,0 +1,187 @@
+/**
+ * @file xyReplay.cpp
+ * @brief Deterministic replay of bus traffic recorded with xyRecordStream
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#include "xyReplay.h"
+
+/** @brief replay stops if the driver does not send the next recorded TX frame within this time, in us */
+#define REPLAY_STUCK_TIMEOUT 10000000UL
+
+xyReplayStream::xyReplayStream(xyVirtualClock& clock)
+{
+  mClock = &clock;
+  mpData = nullptr;
+  mSize = 0;
+  begin();
+}
+
+xyReplayStream::~xyReplayStream()
+{
+  free(mpData);
+}
+
+bool xyReplayStream::load(const char* fileName)
+{
+  FILE* pFile;
+  long size;
+
+  free(mpData);
+  mpData = nullptr;
+  mSize = 0;
+
+  pFile = fopen(fileName, "rb");
+  if( pFile == nullptr )
+    return false;
+  fseek(pFile, 0, SEEK_END);
+  size = ftell(pFile);
+  fseek(pFile, 0, SEEK_SET);
+  if( size >= 5 )
+  {
+    mpData = (unsigned char*)malloc(size);
+    if( mpData != nullptr && fread(mpData, 1, size, pFile) == (size_t)size )
+      mSize = size;
+  }
+  fclose(pFile);
+
+  if( mSize < 5 || memcmp(mpData, "XYRC", 4) != 0 || mpData[4] != XY_REC_VERSION )
+  {
+    mSize = 0;
+    return false;
+  }
+  begin();
+  return true;
+}
+
+void xyReplayStream::begin(void)
+{
+  mPos = 5;
+  mT0 = mClock->get();
+  mTPrev = 0;
+  mTRec = 0;
+  mRxHead = 0;
+  mRxTail = 0;
+  mNbTx = 0;
+  mNbTxMismatch = 0;
+  mTxDevMax = 0;
+  mTxDevSum = 0;
+}
+
+bool xyReplayStream::ReadVarint(size_t& pos, unsigned long& value)
+{
+  byte shift = 0;
+  value = 0;
+  while( pos < mSize && shift < 32 )
+  {
+    value |= (unsigned long)(mpData[pos] & 0x7F) << shift;
+    if( !(mpData[pos++] & 0x80) )
+      return true;
+    shift += 7;
+  }
+  return false;
+}
+
+bool xyReplayStream::Next(byte& tag, size_t& len, size_t& dataPos)
+{
+  size_t pos = mPos;
+  unsigned long dt, n;
+
+  if( pos >= mSize )
+    return false;
+  tag = mpData[pos++];
+  if( !ReadVarint(pos, dt) || !ReadVarint(pos, n) || pos + n > mSize )
+    return false;
+  mTRec = mTPrev + dt;
+  len = n;
+  dataPos = pos;
+  return true;
+}
+
+bool xyReplayStream::done(void)
+{
+  byte tag;
+  size_t len, dataPos;
+  return !Next(tag, len, dataPos) && (mRxHead == mRxTail);
+}
+
+int xyReplayStream::available(void)
+{
+  byte tag;
+  size_t len, dataPos;
+  unsigned long long now = mClock->get() - mT0;
+
+  if( mRxHead == mRxTail )
+    mRxHead = mRxTail = 0;
+  // all RX bursts due till now, a pending TX record blocks the following ones
+  while( Next(tag, len, dataPos) && tag == XY_REC_RX && mTRec <= now &&
+         mRxTail + (int)len <= XY_REPLAY_RX_BUFFER_SIZE )
+  {
+    memcpy(&mRxBuf[mRxTail], &mpData[dataPos], len);
+    mRxTail += len;
+    mPos = dataPos + len;
+    mTPrev = mTRec;
+  }
+  return mRxTail - mRxHead;
+}
+
+int xyReplayStream::read(void)
+{
+  if( available() <= 0 )
+    return -1;
+  return mRxBuf[mRxHead++];
+}
+
+int xyReplayStream::peek(void)
+{
+  if( available() <= 0 )
+    return -1;
+  return mRxBuf[mRxHead];
+}
+
+size_t xyReplayStream::write(const uint8_t* pBuf, size_t size)
+{
+  byte tag;
+  size_t len, dataPos;
+  long deviation;
+  unsigned long long now = mClock->get() - mT0;
+
+  mNbTx++;
+  if( Next(tag, len, dataPos) && tag == XY_REC_TX )
+  {
+    if( len != size || memcmp(&mpData[dataPos], pBuf, size) != 0 )
+      mNbTxMismatch++;
+    deviation = (long)(now - mTRec);
+    if( deviation > mTxDevMax )
+      mTxDevMax = deviation;
+    mTxDevSum += deviation;
+    mPos = dataPos + len;
+    mTPrev = mTRec;
+  }
+  else
+    // not expected at this point of the recording
+    mNbTxMismatch++;
+  return size;
+}
+
+unsigned long long xyReplayStream::run(xy6020l& xy, unsigned long tickUs, tReplayLoop loop, void* pUser)
+{
+  byte tag;
+  size_t len, dataPos;
+
+  begin();
+  while( !done() )
+  {
+    xy.task();
+    if( loop != nullptr )
+      loop(xy, pUser);
+    mClock->advance(tickUs);
+    // driver does not send the recorded frame anymore
+    if( Next(tag, len, dataPos) && (mClock->get() - mT0) > mTRec + REPLAY_STUCK_TIMEOUT )
+      break;
+  }
+  return mClock->get() - mT0;
+}
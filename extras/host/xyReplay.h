@@ -0,0 +1,90 @@
+/**
+ * @file xyReplay.h
+ * @brief Deterministic replay of bus traffic recorded with xyRecordStream
+ *
+ * xyReplayStream replaces the serial port of a xy6020l driver: recorded RX bursts become available
+ * at their recorded time, TX frames of the driver are compared with the recorded ones.
+ * Replay and driver share a xyVirtualClock, so the replay runs as fast as the CPU allows with the same byte arrival timing
+ * as seen in the field, so recordings are a regression and benchmark corpus for decoder and scheduler changes.
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xyReplay_h
+#define xyReplay_h
+
+#include "Arduino.h"
+#include "xy6020l.h"
+#include "xy6020l_record.h"
+#include "xy6020l_clock.h"
+
+#define XY_REPLAY_RX_BUFFER_SIZE 256
+
+/** @brief application part of the replayed loop, called after each xy6020l::task() */
+typedef void (*tReplayLoop)(xy6020l& xy, void* pUser);
+
+class xyReplayStream : public Stream
+{
+  public:
+    /** @param clock virtual time base, the replayed driver must use the same */
+    xyReplayStream(xyVirtualClock& clock);
+    ~xyReplayStream();
+    /** @brief loads a recording into memory, false if file is missing or no recording */
+    bool load(const char* fileName);
+    /** @brief starts the replay at the actual time of the clock */
+    void begin(void);
+    /** @brief true if all records are replayed and read */
+    bool done(void);
+    /**
+     * @brief replays the whole recording against the driver
+     * @param tickUs virtual time between 2 calls of xy6020l::task()
+     * @param loop application calls of the recorded loop (setCV() ...), nullptr: driver only
+     * @return replayed time in us
+     */
+    unsigned long long run(xy6020l& xy, unsigned long tickUs=100, tReplayLoop loop=nullptr, void* pUser=nullptr);
+
+    int available(void);
+    int read(void);
+    int peek(void);
+    size_t write(uint8_t c) { return write(&c, 1); };
+    size_t write(const uint8_t* pBuf, size_t size);
+    using Print::write;
+
+    /// @name replay result
+    /// @{
+    unsigned long getNbTx(void) { return mNbTx; };
+    /** @brief TX frames different from the recording or not expected at all */
+    unsigned long getNbTxMismatch(void) { return mNbTxMismatch; };
+    /** @brief TX time deviation from the recording, in us, positive: later */
+    long getTxDeviationMax(void) { return mTxDevMax; };
+    long getTxDeviationAvg(void) { return mNbTx > 0 ? (long)(mTxDevSum / (long long)mNbTx) : 0; };
+    /// @}
+
+  private:
+    xyVirtualClock* mClock;
+    unsigned char* mpData;
+    size_t        mSize;
+    /** @brief next record */
+    size_t        mPos;
+    /** @brief times without wrap around from the virtual clock, recordings may be longer than 71 minutes */
+    unsigned long long mT0;
+    /** @brief time of the next record since begin(), in us */
+    unsigned long long mTRec;
+    unsigned long long mTPrev;
+
+    unsigned char mRxBuf[XY_REPLAY_RX_BUFFER_SIZE];
+    int           mRxHead;
+    int           mRxTail;
+
+    unsigned long mNbTx;
+    unsigned long mNbTxMismatch;
+    long          mTxDevMax;
+    long long     mTxDevSum;
+
+    /** @brief parses the header of the next record, false at end of recording */
+    bool Next(byte& tag, size_t& len, size_t& dataPos);
+    bool ReadVarint(size_t& pos, unsigned long& value);
+};
+#endif
@@ -0,0 +1,338 @@
+/**
+ * @file xyShm.cpp
+ * @brief Shared memory export of the XY6020L register snapshots on a Linux host
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#include "xyShm.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sched.h>
+
+/** @brief unit blocks start 8 byte aligned */
+#define SHM_ALIGN(n) ( ((n) + 7) & ~(size_t)7 )
+#define SHM_UNITS_OFFSET SHM_ALIGN(sizeof(tXyShmHeader))
+/** @brief busy polls of a locked unit before the reader yields and checks the writer timeout */
+#define SHM_SPINS 1000
+
+static uint64_t realtimeUs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+static uint64_t monotonicUs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+xyShmPublisher::xyShmPublisher(const char* name, byte nbUnits, uint32_t histLen)
+{
+  mName = name;
+  mNbUnits = nbUnits;
+  mHistLen = histLen > 0 ? histLen : 1;
+  mpMem = nullptr;
+  mSize = 0;
+  mpRxTime = (uint32_t*)calloc(mNbUnits > 0 ? mNbUnits : 1, sizeof(uint32_t));
+}
+
+xyShmPublisher::~xyShmPublisher()
+{
+  end(false);
+  free(mpRxTime);
+}
+
+bool xyShmPublisher::begin(void)
+{
+  int fd;
+  struct stat st;
+  tXyShmHeader* pHeader;
+  size_t unitSize = SHM_ALIGN( sizeof(tXyShmUnit) + mHistLen * sizeof(tXyShmSample) );
+
+  end(false);
+  mSize = SHM_UNITS_OFFSET + mNbUnits * unitSize;
+  if( mpRxTime != nullptr )
+    memset(mpRxTime, 0, mNbUnits * sizeof(uint32_t));
+
+  // segment of a former begin(), readers may still have it mapped
+  fd = shm_open(mName, O_RDWR, 0);
+  if( fd >= 0 )
+  {
+    if( fstat(fd, &st) == 0 && (size_t)st.st_size >= SHM_UNITS_OFFSET )
+    {
+      mpMem = (unsigned char*)mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if( mpMem == MAP_FAILED )
+        mpMem = nullptr;
+    }
+    ::close(fd);
+    if( mpMem != nullptr )
+    {
+      pHeader = (tXyShmHeader*)mpMem;
+      if( (size_t)st.st_size == mSize && pHeader->Magic == XY_SHM_MAGIC && pHeader->Version == XY_SHM_VERSION &&
+          pHeader->NbUnits == mNbUnits && pHeader->NbRegs == NB_HREGS && pHeader->HistLen == mHistLen &&
+          pHeader->UnitSize == unitSize )
+      {
+        Restart();
+        return true;
+      }
+      // other layout: readers of the old segment fail in readBegin() and reopen, a ftruncate() under their mapping would raise SIGBUS
+      __atomic_store_n(&pHeader->Magic, 0, __ATOMIC_RELEASE);
+      munmap(mpMem, st.st_size);
+      mpMem = nullptr;
+    }
+    shm_unlink(mName);
+  }
+
+  fd = shm_open(mName, O_CREAT | O_EXCL | O_RDWR, 0644);
+  if( fd < 0 )
+    return false;
+  if( ftruncate(fd, mSize) != 0 )
+  {
+    ::close(fd);
+    return false;
+  }
+  mpMem = (unsigned char*)mmap(nullptr, mSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if( mpMem == MAP_FAILED )
+  {
+    mpMem = nullptr;
+    return false;
+  }
+
+  // readers check the magic, it is written as last
+  pHeader = (tXyShmHeader*)mpMem;
+  __atomic_store_n(&pHeader->Magic, 0, __ATOMIC_RELAXED);
+  memset(mpMem + sizeof(pHeader->Magic), 0, mSize - sizeof(pHeader->Magic));
+  pHeader->Version = XY_SHM_VERSION;
+  pHeader->NbUnits = mNbUnits;
+  pHeader->NbRegs = NB_HREGS;
+  pHeader->HistLen = mHistLen;
+  pHeader->UnitSize = unitSize;
+  __atomic_store_n(&pHeader->Magic, (uint32_t)XY_SHM_MAGIC, __ATOMIC_RELEASE);
+  return true;
+}
+
+/**
+ * @brief clears the unit blocks of a segment with the same layout under the sequence lock
+ * The sequence keeps counting up instead of restarting at 0, so a reader which began before can not
+ * see the same sequence again after the restart.
+ */
+void xyShmPublisher::Restart(void)
+{
+  tXyShmHeader* pHeader = (tXyShmHeader*)mpMem;
+  tXyShmUnit* pUnit;
+  uint32_t seq;
+
+  for(byte unit=0; unit < mNbUnits; unit++)
+  {
+    pUnit = (tXyShmUnit*)( mpMem + SHM_UNITS_OFFSET + unit * pHeader->UnitSize );
+    // odd, also if a former publisher died while writing
+    seq = pUnit->Seq | 1;
+    __atomic_store_n(&pUnit->Seq, seq, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memset((unsigned char*)pUnit + sizeof(pUnit->Seq), 0, pHeader->UnitSize - sizeof(pUnit->Seq));
+    __atomic_store_n(&pUnit->Seq, seq + 1, __ATOMIC_RELEASE);
+  }
+}
+
+void xyShmPublisher::end(bool unlink)
+{
+  if( mpMem != nullptr )
+    munmap(mpMem, mSize);
+  mpMem = nullptr;
+  if( unlink )
+    shm_unlink(mName);
+}
+
+bool xyShmPublisher::publish(byte unit, xy6020l& xy)
+{
+  tXyShmHeader* pHeader = (tXyShmHeader*)mpMem;
+  tXyShmUnit* pUnit;
+  tXyShmSample* pSample;
+  uint32_t seq;
+  uint64_t tUs;
+  byte i;
+
+  if( mpMem == nullptr || mpRxTime == nullptr || unit >= mNbUnits || !xy.HRegValid() )
+    return false;
+  pUnit = (tXyShmUnit*)( mpMem + SHM_UNITS_OFFSET + unit * pHeader->UnitSize );
+  // no new answer since the last publish -> no duplicate history sample
+  if( pUnit->HistCnt > 0 && xy.getRxTime() == mpRxTime[unit] )
+    return false;
+  mpRxTime[unit] = xy.getRxTime();
+  pSample = (tXyShmSample*)( pUnit + 1 ) + pUnit->HistCnt % mHistLen;
+  // time stamp of the answer, not of the publishing
+  tUs = realtimeUs() - (uint64_t)(xy.getClock().millis() - xy.getRxTime()) * 1000ULL;
+
+  seq = pUnit->Seq;
+  __atomic_store_n(&pUnit->Seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  pUnit->Adr = xy.getAdr();
+  pUnit->TUs = tUs;
+  for(i=0; i < NB_HREGS; i++)
+    pUnit->Regs[i] = xy.getHReg(i);
+  pSample->TUs  = tUs;
+  pSample->ActV = xy.getActV();
+  pSample->ActC = xy.getActC();
+  pSample->ActP = xy.getActP();
+  pSample->InV  = xy.getInV();
+  pUnit->HistCnt++;
+
+  __atomic_store_n(&pUnit->Seq, seq + 2, __ATOMIC_RELEASE);
+  return true;
+}
+
+xyShmReader::xyShmReader(const char* name)
+{
+  mName = name;
+  mpMem = nullptr;
+  mSize = 0;
+  mpHeader = nullptr;
+}
+
+xyShmReader::~xyShmReader()
+{
+  close();
+}
+
+bool xyShmReader::open(void)
+{
+  int fd;
+  struct stat st;
+  const tXyShmHeader* pHeader;
+
+  close();
+  fd = shm_open(mName, O_RDONLY, 0);
+  if( fd < 0 )
+    return false;
+  if( fstat(fd, &st) != 0 || (size_t)st.st_size < SHM_UNITS_OFFSET )
+  {
+    ::close(fd);
+    return false;
+  }
+  mSize = st.st_size;
+  mpMem = (const unsigned char*)mmap(nullptr, mSize, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if( mpMem == MAP_FAILED )
+  {
+    mpMem = nullptr;
+    return false;
+  }
+  pHeader = (const tXyShmHeader*)mpMem;
+  if( __atomic_load_n(&pHeader->Magic, __ATOMIC_ACQUIRE) != XY_SHM_MAGIC || pHeader->Version != XY_SHM_VERSION ||
+      SHM_UNITS_OFFSET + (size_t)pHeader->NbUnits * pHeader->UnitSize > mSize ||
+      pHeader->NbRegs > XY_SHM_MAX_REGS )
+  {
+    close();
+    return false;
+  }
+  mpHeader = pHeader;
+  return true;
+}
+
+void xyShmReader::close(void)
+{
+  if( mpMem != nullptr )
+    munmap((void*)mpMem, mSize);
+  mpMem = nullptr;
+  mpHeader = nullptr;
+}
+
+const tXyShmUnit* xyShmReader::getUnit(byte unit)
+{
+  if( mpHeader == nullptr || unit >= mpHeader->NbUnits )
+    return nullptr;
+  return (const tXyShmUnit*)( mpMem + SHM_UNITS_OFFSET + unit * mpHeader->UnitSize );
+}
+
+const tXyShmSample* xyShmReader::getHist(byte unit)
+{
+  const tXyShmUnit* pUnit = getUnit(unit);
+  return pUnit != nullptr ? (const tXyShmSample*)( pUnit + 1 ) : nullptr;
+}
+
+bool xyShmReader::readBegin(byte unit, uint32_t& seq)
+{
+  const tXyShmUnit* pUnit = getUnit(unit);
+  uint32_t spins = 0;
+  uint64_t t0 = 0;
+
+  if( pUnit == nullptr )
+    return false;
+  // segment replaced by a publisher with another layout
+  if( __atomic_load_n(&mpHeader->Magic, __ATOMIC_ACQUIRE) != XY_SHM_MAGIC )
+    return false;
+  // wait till writer is done, a publisher which died while writing leaves the sequence odd
+  while( (seq = __atomic_load_n(&pUnit->Seq, __ATOMIC_ACQUIRE)) & 1 )
+  {
+    if( ++spins < SHM_SPINS )
+      continue;
+    if( t0 == 0 )
+      t0 = monotonicUs();
+    else if( monotonicUs() - t0 > XY_SHM_WRITER_TIMEOUT )
+      return false;
+    sched_yield();
+  }
+  return true;
+}
+
+bool xyShmReader::readValid(byte unit, uint32_t seq)
+{
+  const tXyShmUnit* pUnit = getUnit(unit);
+
+  if( pUnit == nullptr )
+    return false;
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&pUnit->Seq, __ATOMIC_RELAXED) == seq;
+}
+
+bool xyShmReader::latest(byte unit, tXyShmUnit& snapshot)
+{
+  const tXyShmUnit* pUnit = getUnit(unit);
+  uint32_t seq;
+
+  if( pUnit == nullptr )
+    return false;
+  do
+  {
+    if( !readBegin(unit, seq) )
+      return false;
+    memcpy(&snapshot, pUnit, sizeof(tXyShmUnit));
+  } while( !readValid(unit, seq) );
+  return snapshot.TUs != 0;
+}
+
+uint32_t xyShmReader::history(byte unit, tXyShmSample* pDst, uint32_t maxCnt)
+{
+  const tXyShmUnit* pUnit = getUnit(unit);
+  const tXyShmSample* pHist = getHist(unit);
+  uint32_t seq, cnt, i, histLen;
+  uint64_t histCnt;
+
+  if( pUnit == nullptr )
+    return 0;
+  histLen = mpHeader->HistLen;
+  do
+  {
+    if( !readBegin(unit, seq) )
+      return 0;
+    histCnt = pUnit->HistCnt;
+    cnt = histCnt < histLen ? (uint32_t)histCnt : histLen;
+    if( cnt > maxCnt )
+      cnt = maxCnt;
+    // oldest first
+    for(i=0; i < cnt; i++)
+      pDst[i] = pHist[ (histCnt - cnt + i) % histLen ];
+  } while( !readValid(unit, seq) );
+  return cnt;
+}
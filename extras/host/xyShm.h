@@ -0,0 +1,155 @@
+/**
+ * @file xyShm.h
+ * @brief Shared memory export of the XY6020L register snapshots on a Linux host
+ *
+ * The publisher writes the latest holding registers and a history ring of time stamped V/I/P samples
+ * of each converter into a POSIX shared memory segment. Readers in other processes map it read only
+ * and access the data without copies through the socket or syscalls per sample.
+ * Each unit block is protected by a sequence lock: the writer makes the sequence odd while it updates,
+ * a reader retries if the sequence was odd or changed during its access.
+ *
+ * Layout (version XY_SHM_VERSION):
+ *  - tXyShmHeader
+ *  - NbUnits x UnitSize bytes:  tXyShmUnit followed by HistLen x tXyShmSample
+ *
+ * Link with -lrt on older glibc.
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xyShm_h
+#define xyShm_h
+
+#include "Arduino.h"
+#include "xy6020l.h"
+
+#define XY_SHM_MAGIC 0x48535958UL
+#define XY_SHM_VERSION 1
+#define XY_SHM_MAX_REGS 32
+/** @brief readers give up if a unit stays locked longer, i.e. the publisher died while writing, in us */
+#define XY_SHM_WRITER_TIMEOUT 100000ULL
+
+typedef struct {
+    uint32_t Magic;
+    uint16_t Version;
+    uint16_t NbUnits;
+    uint16_t NbRegs;
+    uint16_t Reserved;
+    uint32_t HistLen;
+    /** @brief bytes per unit block incl. history */
+    uint32_t UnitSize;
+} tXyShmHeader;
+
+/** @brief history entry */
+typedef struct {
+    /** @brief time stamp, CLOCK_REALTIME in us */
+    uint64_t TUs;
+    /** @brief LSB 0.01 V */
+    uint16_t ActV;
+    /** @brief LSB 0.01 A */
+    uint16_t ActC;
+    /** @brief LSB 0.01 W */
+    uint16_t ActP;
+    /** @brief LSB 0.01 V */
+    uint16_t InV;
+} tXyShmSample;
+
+typedef struct {
+    /** @brief sequence lock, odd while writing */
+    uint32_t Seq;
+    uint8_t  Adr;
+    uint8_t  Reserved[3];
+    /** @brief time stamp of Regs, CLOCK_REALTIME in us, 0: no data yet */
+    uint64_t TUs;
+    uint16_t Regs[XY_SHM_MAX_REGS];
+    /** @brief number of samples written to the history ring since start, newest at (HistCnt-1) % HistLen */
+    uint64_t HistCnt;
+} tXyShmUnit;
+
+/**
+ * @class xyShmPublisher
+ * @brief creates the segment and publishes the snapshots of the controller process
+ */
+class xyShmPublisher
+{
+  public:
+    /**
+     * @param name shared memory name, i.e. "/xy6020l"
+     * @param nbUnits number of converters
+     * @param histLen entries of the history ring per unit
+     */
+    xyShmPublisher(const char* name, byte nbUnits=1, uint32_t histLen=1024);
+    ~xyShmPublisher();
+    /**
+     * @brief creates the segment or restarts an existing one
+     * A segment with the same layout is cleared in place, readers keep their mapping and see no data till the next publish.
+     * A segment with another layout is unlinked and created new, readers of the old one fail in readBegin() and have to reopen.
+     */
+    bool begin(void);
+    /** @param unlink removes the segment, readers keep their mapping */
+    void end(bool unlink=true);
+    /**
+     * @brief publishes the actual register cache of the driver, call it after xy6020l::HRegUpdated()
+     * @return false if not published: not begun, unit out of range or no new answer since the last publish
+     *         of this unit (same getRxTime(), i.e. HRegUpdated() after a timeout)
+     */
+    bool publish(byte unit, xy6020l& xy);
+
+  private:
+    const char*   mName;
+    byte          mNbUnits;
+    uint32_t      mHistLen;
+    unsigned char* mpMem;
+    size_t        mSize;
+    /** @brief getRxTime() of the last publish of each unit */
+    uint32_t*     mpRxTime;
+
+    void Restart(void);
+};
+
+/**
+ * @class xyShmReader
+ * @brief maps the segment read only in any process
+ */
+class xyShmReader
+{
+  public:
+    xyShmReader(const char* name);
+    ~xyShmReader();
+    /** @brief maps the segment, false if missing or incompatible version */
+    bool open(void);
+    void close(void);
+
+    byte getNbUnits(void) { return mpHeader != nullptr ? mpHeader->NbUnits : 0; };
+    uint32_t getHistLen(void) { return mpHeader != nullptr ? mpHeader->HistLen : 0; };
+
+    /** @brief consistent copy of the latest registers, false if no data yet, the unit stays locked or the segment was replaced */
+    bool latest(byte unit, tXyShmUnit& snapshot);
+    /**
+     * @brief consistent copy of the newest history samples, oldest first
+     * @return number of samples copied, 0 if the unit stays locked or the segment was replaced
+     */
+    uint32_t history(byte unit, tXyShmSample* pDst, uint32_t maxCnt);
+
+    /// @name zero copy access: read the data between readBegin() and readValid(), retry if invalid
+    /// @{
+    const tXyShmUnit* getUnit(byte unit);
+    const tXyShmSample* getHist(byte unit);
+    /**
+     * @brief waits till the writer is done and returns its sequence in seq
+     * @return false if the unit stays locked for XY_SHM_WRITER_TIMEOUT (publisher died while writing), is unknown
+     *         or the segment was replaced by a publisher with another layout (reopen it)
+     */
+    bool readBegin(byte unit, uint32_t& seq);
+    bool readValid(byte unit, uint32_t seq);
+    /// @}
+
+  private:
+    const char*   mName;
+    const unsigned char* mpMem;
+    size_t        mSize;
+    const tXyShmHeader* mpHeader;
+};
+#endif
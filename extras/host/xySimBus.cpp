@@ -0,0 +1,373 @@
+/**
+ * @file xySimBus.cpp
+ * @brief Simulated XY6020L units on a virtual RS485 bus for host tests and benchmarks
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#include "xySimBus.h"
+
+xySimBus::xySimBus(xyVirtualClock& clock, unsigned long bps, unsigned long turnaroundUs)
+{
+  mClock = &clock;
+  setBaud(bps);
+  mTurnaround = turnaroundUs;
+  mJitter = 0;
+  mLateEvery = 0;
+  mLateUs = 0;
+  mRandom = 1;
+  mNbUnits = 0;
+  mNbFrames = 0;
+  mNbRequests = 0;
+  mNbCollisions = 0;
+  mNbLate = 0;
+}
+
+void xySimBus::setBaud(unsigned long bps)
+{
+  mBps = bps;
+  mByteUs = bps > 0 ? 10000000UL / bps : 0;
+}
+
+bool xySimBus::addUnit(byte adr, byte baud)
+{
+  tSimUnit* pUnit;
+  unsigned long bps = baud == 255 ? mBps : xy6020l::BaudToRate(baud);
+
+  // the line rate as baud rate number
+  for(byte b=0; baud == 255 && b < XY_BAUD_NB; b++)
+  {
+    if( xy6020l::BaudToRate(b) == mBps )
+      baud = b;
+  }
+  if( mNbUnits >= XY_SIM_MAX_UNITS || adr == 0 || bps == 0 )
+    return false;
+  for(byte i=0; i < mNbUnits; i++)
+  {
+    if( mUnits[i].Adr == adr && mUnits[i].Bps == bps )
+      return false;
+  }
+  pUnit = &mUnits[mNbUnits++];
+  memset(pUnit, 0, sizeof(tSimUnit));
+  pUnit->Adr = adr;
+  pUnit->Bps = bps;
+  pUnit->BaudMode = XY_SIM_BAUD_NOW;
+  pUnit->TCnt = mClock->get();
+  pUnit->Regs[HREG_IDX_CV] = 500;
+  pUnit->Regs[HREG_IDX_CC] = 100;
+  pUnit->Regs[HREG_IDX_IN_V] = 2400;
+  pUnit->Regs[HREG_IDX_MODEL] = 0x6500;
+  pUnit->Regs[HREG_IDX_VERSION] = 0x71;
+  pUnit->Regs[HREG_IDX_SLAVE_ADD] = adr;
+  pUnit->Regs[HREG_IDX_BAUDRATE] = baud < XY_BAUD_NB ? baud : XY_BAUD_115200;
+  for(byte m=0; m < XY_SIM_NB_MEMORIES; m++)
+  {
+    pUnit->Mem[m][HREG_IDX_M_VSET] = 500 + m * 100;
+    pUnit->Mem[m][HREG_IDX_M_ISET] = 100 + m;
+  }
+  return true;
+}
+
+xySimBus::tSimUnit* xySimBus::FindUnit(byte adr, bool anyRate)
+{
+  for(byte i=0; i < mNbUnits; i++)
+  {
+    if( mUnits[i].Adr == adr && ( anyRate || mUnits[i].Bps == mBps ) )
+      return &mUnits[i];
+  }
+  return nullptr;
+}
+
+void xySimBus::setBaudMode(byte adr, tSimBaudMode mode)
+{
+  tSimUnit* pUnit = FindUnit(adr);
+  if( pUnit != nullptr )
+    pUnit->BaudMode = mode;
+}
+
+void xySimBus::resetUnit(byte adr)
+{
+  tSimUnit* pUnit = FindUnit(adr);
+  if( pUnit != nullptr && xy6020l::BaudToRate(pUnit->Regs[HREG_IDX_BAUDRATE]) > 0 )
+    pUnit->Bps = xy6020l::BaudToRate(pUnit->Regs[HREG_IDX_BAUDRATE]);
+}
+
+word* xySimBus::getRegs(byte adr)
+{
+  tSimUnit* pUnit = FindUnit(adr);
+  return pUnit != nullptr ? pUnit->Regs : nullptr;
+}
+
+word* xySimBus::getMem(byte adr, byte nr)
+{
+  tSimUnit* pUnit = FindUnit(adr);
+  return (pUnit != nullptr && nr < XY_SIM_NB_MEMORIES) ? pUnit->Mem[nr] : nullptr;
+}
+
+void xySimBus::resetCounters(byte adr)
+{
+  tSimUnit* pUnit = FindUnit(adr);
+  if( pUnit != nullptr )
+  {
+    Count(pUnit);
+    pUnit->QAcc = 0;
+    pUnit->EAcc = 0;
+    pUnit->Regs[HREG_IDX_OUT_CHRG] = 0;
+    pUnit->Regs[HREG_IDX_OUT_CHRG_HIGH] = 0;
+    pUnit->Regs[HREG_IDX_OUT_ENERGY] = 0;
+    pUnit->Regs[HREG_IDX_OUT_ENERGY_HIGH] = 0;
+  }
+}
+
+double xySimBus::getCharge(byte adr)
+{
+  tSimUnit* pUnit = FindUnit(adr);
+  if( pUnit == nullptr )
+    return 0;
+  Count(pUnit);
+  return pUnit->QTotal / 3.6e8;
+}
+
+double xySimBus::getEnergy(byte adr)
+{
+  tSimUnit* pUnit = FindUnit(adr);
+  if( pUnit == nullptr )
+    return 0;
+  Count(pUnit);
+  return pUnit->ETotal / 3.6e10;
+}
+
+void xySimBus::Count(tSimUnit* pUnit)
+{
+  word* pRegs = pUnit->Regs;
+  unsigned long long dt = mClock->get() - pUnit->TCnt;
+  unsigned long cnt;
+
+  pUnit->TCnt = mClock->get();
+  // 0.001 Ah = 3.6e8 x 0.01 A x us, 0.001 Wh = 3.6e10 x 0.0001 W x us
+  pUnit->QAcc += (unsigned long long)pRegs[HREG_IDX_ACT_C] * dt;
+  pUnit->EAcc += (unsigned long long)pRegs[HREG_IDX_ACT_V] * pRegs[HREG_IDX_ACT_C] * dt;
+  pUnit->QTotal += (unsigned long long)pRegs[HREG_IDX_ACT_C] * dt;
+  pUnit->ETotal += (unsigned long long)pRegs[HREG_IDX_ACT_V] * pRegs[HREG_IDX_ACT_C] * dt;
+  cnt = ((unsigned long)pRegs[HREG_IDX_OUT_CHRG_HIGH] << 16 | pRegs[HREG_IDX_OUT_CHRG]) + (unsigned long)(pUnit->QAcc / 360000000ULL);
+  pUnit->QAcc %= 360000000ULL;
+  pRegs[HREG_IDX_OUT_CHRG] = cnt & 0xFFFF;
+  pRegs[HREG_IDX_OUT_CHRG_HIGH] = cnt >> 16;
+  cnt = ((unsigned long)pRegs[HREG_IDX_OUT_ENERGY_HIGH] << 16 | pRegs[HREG_IDX_OUT_ENERGY]) + (unsigned long)(pUnit->EAcc / 36000000000ULL);
+  pUnit->EAcc %= 36000000000ULL;
+  pRegs[HREG_IDX_OUT_ENERGY] = cnt & 0xFFFF;
+  pRegs[HREG_IDX_OUT_ENERGY_HIGH] = cnt >> 16;
+}
+
+void xySimBus::DropFrame(byte idx)
+{
+  mNbFrames--;
+  for(byte i=idx; i < mNbFrames; i++)
+    mFrames[i] = mFrames[i+1];
+}
+
+byte xySimBus::Arrived(void)
+{
+  unsigned long long now = mClock->get();
+  unsigned long long n;
+
+  if( mNbFrames == 0 || now < mFrames[0].Start )
+    return 0;
+  n = mByteUs > 0 ? (now - mFrames[0].Start) / mByteUs : mFrames[0].Len;
+  return n > mFrames[0].Len ? mFrames[0].Len : (byte)n;
+}
+
+int xySimBus::available(void)
+{
+  // answers follow each other, only the first one can be on the line
+  while( mNbFrames > 0 && mFrames[0].Pos >= mFrames[0].Len )
+    DropFrame(0);
+  return mNbFrames > 0 ? Arrived() - mFrames[0].Pos : 0;
+}
+
+int xySimBus::read(void)
+{
+  if( available() <= 0 )
+    return -1;
+  return mFrames[0].Data[mFrames[0].Pos++];
+}
+
+int xySimBus::peek(void)
+{
+  if( available() <= 0 )
+    return -1;
+  return mFrames[0].Data[mFrames[0].Pos];
+}
+
+size_t xySimBus::write(const uint8_t* pBuf, size_t size)
+{
+  unsigned long long now = mClock->get();
+  unsigned long long txEnd = now + size * mByteUs;
+  unsigned long long start, end;
+  bool collision = false;
+  word crc;
+  tSimUnit* pUnit;
+  tSimFrame* pFrame;
+  byte i;
+
+  // answer on the line meanwhile ?
+  i = 0;
+  while( i < mNbFrames )
+  {
+    start = mFrames[i].Start;
+    end = start + mFrames[i].Len * mByteUs;
+    if( now < end && txEnd > start )
+    {
+      collision = true;
+      DropFrame(i);
+    }
+    else
+      i++;
+  }
+  if( collision )
+  {
+    mNbCollisions++;
+    return size;
+  }
+
+  if( size < 8 )
+    return size;
+  crc = xy6020l::CRC(pBuf, size - 2);
+  if( pBuf[size-2] != (crc & 0xFF) || pBuf[size-1] != (crc >> 8) )
+    return size;
+
+  // broadcast: fct 6 to all units, no answer
+  if( pBuf[0] == 0 )
+  {
+    if( pBuf[1] == 0x06 && pBuf[3] < NB_HREGS && pBuf[2] == 0 )
+    {
+      for(i=0; i < mNbUnits; i++)
+      {
+        if( mUnits[i].Bps == mBps )
+          mUnits[i].Regs[pBuf[3]] = (word)pBuf[4] * 256 + pBuf[5];
+      }
+    }
+    return size;
+  }
+
+  pUnit = FindUnit(pBuf[0], false);
+  if( pUnit == nullptr || mNbFrames >= XY_SIM_MAX_FRAMES )
+    return size;
+  mNbRequests++;
+  pFrame = &mFrames[mNbFrames];
+  pFrame->Len = Answer(pUnit, pBuf, size, pFrame->Data);
+  if( pFrame->Len == 0 )
+    return size;
+
+  mRandom = mRandom * 1103515245UL + 12345UL;
+  start = txEnd + mTurnaround + ( mJitter > 0 ? (mRandom >> 8) % (mJitter + 1) : 0 );
+  if( mLateEvery > 0 && (mNbRequests % mLateEvery) == 0 )
+  {
+    start += mLateUs;
+    mNbLate++;
+  }
+  // a unit does not answer before the previous answer left the line
+  if( mNbFrames > 0 )
+  {
+    end = mFrames[mNbFrames-1].Start + mFrames[mNbFrames-1].Len * mByteUs;
+    if( start < end )
+      start = end;
+  }
+  pFrame->Pos = 0;
+  pFrame->Start = start;
+  mNbFrames++;
+  return size;
+}
+
+byte xySimBus::Answer(tSimUnit* pUnit, const uint8_t* pReq, size_t len, unsigned char* pAns)
+{
+  word start = (word)pReq[2] * 256 + pReq[3];
+  word cnt = (word)pReq[4] * 256 + pReq[5];
+  word* pSrc = nullptr;
+  word* pRegs = pUnit->Regs;
+  byte n = 0;
+  byte exception = 0;
+  word crc;
+
+  // counters with the output state till now, then the simple output model: voltage follows the setpoint, half the current limit flows
+  Count(pUnit);
+  pRegs[HREG_IDX_ACT_V] = pRegs[HREG_IDX_OUTPUT_ON] ? pRegs[HREG_IDX_CV] : 0;
+  pRegs[HREG_IDX_ACT_C] = pRegs[HREG_IDX_OUTPUT_ON] ? pRegs[HREG_IDX_CC] / 2 : 0;
+  pRegs[HREG_IDX_ACT_P] = (word)( (unsigned long)pRegs[HREG_IDX_ACT_V] * pRegs[HREG_IDX_ACT_C] / 1000 );
+
+  pAns[0] = pReq[0];
+  pAns[1] = pReq[1];
+  switch( pReq[1] )
+  {
+    case 0x03:
+      if( cnt >= 1 && start + cnt <= NB_HREGS )
+        pSrc = &pRegs[start];
+      else if( start >= HREG_IDX_M0 && (start - HREG_IDX_M0) % HREG_IDX_M_OFFSET == 0 &&
+               (start - HREG_IDX_M0) / HREG_IDX_M_OFFSET < XY_SIM_NB_MEMORIES && cnt >= 1 && cnt <= NB_MEMREGS )
+        pSrc = pUnit->Mem[(start - HREG_IDX_M0) / HREG_IDX_M_OFFSET];
+      if( pSrc == nullptr )
+      {
+        exception = 0x02;
+        break;
+      }
+      pAns[2] = 2 * cnt;
+      for(word i=0; i < cnt; i++)
+      {
+        pAns[3+2*i] = pSrc[i] >> 8;
+        pAns[4+2*i] = pSrc[i] & 0xFF;
+      }
+      n = 3 + 2 * cnt;
+      break;
+    case 0x06:
+      if( start >= NB_HREGS )
+      {
+        exception = 0x02;
+        break;
+      }
+      if( start == HREG_IDX_BAUDRATE )
+      {
+        if( xy6020l::BaudToRate(cnt) == 0 || pUnit->BaudMode == XY_SIM_BAUD_REFUSE )
+        {
+          exception = 0x03;
+          break;
+        }
+        pRegs[start] = cnt;
+        if( pUnit->BaudMode != XY_SIM_BAUD_AFTER_RESET )
+          pUnit->Bps = xy6020l::BaudToRate(cnt);
+        if( pUnit->BaudMode == XY_SIM_BAUD_NO_ACK )
+          return 0;
+      }
+      pRegs[start] = cnt;
+      memcpy(pAns, pReq, 6);
+      n = 6;
+      break;
+    case 0x10:
+      if( start < HREG_IDX_M0 || (start - HREG_IDX_M0) % HREG_IDX_M_OFFSET != 0 ||
+          (start - HREG_IDX_M0) / HREG_IDX_M_OFFSET >= XY_SIM_NB_MEMORIES ||
+          cnt != NB_MEMREGS || len < 9 + 2 * (size_t)cnt )
+      {
+        exception = 0x02;
+        break;
+      }
+      for(word i=0; i < cnt; i++)
+        pUnit->Mem[(start - HREG_IDX_M0) / HREG_IDX_M_OFFSET][i] = (word)pReq[7+2*i] * 256 + pReq[8+2*i];
+      memcpy(pAns, pReq, 6);
+      n = 6;
+      break;
+    default:
+      exception = 0x01;
+      break;
+  }
+  if( exception )
+  {
+    pAns[1] |= 0x80;
+    pAns[2] = exception;
+    n = 3;
+  }
+  crc = xy6020l::CRC(pAns, n);
+  pAns[n] = crc & 0xFF;
+  pAns[n+1] = crc >> 8;
+  return n + 2;
+}
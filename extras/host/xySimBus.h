@@ -0,0 +1,144 @@
+/**
+ * @file xySimBus.h
+ * @brief Simulated XY6020L units on a virtual RS485 bus for host tests and benchmarks
+ *
+ * xySimBus replaces the serial port of one or more xy6020l drivers. Frames written by a driver are answered
+ * by the simulated unit with the same slave address, slave address 0 writes all units without answer.
+ * The answer bytes become available at the line rate after the turnaround time of the unit, all on a xyVirtualClock,
+ * so hours of bus traffic run in seconds with the same result on each run.
+ * A frame written while an answer is on the line collides with it: both are lost.
+ * Each unit listens at its own baud rate, frames at another line rate do not reach it.
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xySimBus_h
+#define xySimBus_h
+
+#include "Arduino.h"
+#include "xy6020l.h"
+#include "xy6020l_clock.h"
+
+#define XY_SIM_MAX_UNITS 8
+/** @brief answers on the line or waiting for their turnaround */
+#define XY_SIM_MAX_FRAMES 8
+#define XY_SIM_FRAME_SIZE (5 + 2*NB_HREGS)
+#define XY_SIM_NB_MEMORIES 10
+
+/** @brief behaviour of a unit on a write of HREG_IDX_BAUDRATE */
+typedef enum {
+  /** @brief acknowledged at the old rate, the new one applies at once */
+  XY_SIM_BAUD_NOW = 0,
+  /** @brief acknowledged, the new rate applies with resetUnit() */
+  XY_SIM_BAUD_AFTER_RESET,
+  /** @brief refused with exception 3, register unchanged */
+  XY_SIM_BAUD_REFUSE,
+  /** @brief applies at once, the acknowledge is lost */
+  XY_SIM_BAUD_NO_ACK
+} tSimBaudMode;
+
+class xySimBus : public Stream
+{
+  public:
+    /**
+     * @param clock virtual time base, the drivers on this bus must use the same
+     * @param bps line rate, 10 bits per byte
+     * @param turnaroundUs answer time of a unit after the end of the request
+     */
+    xySimBus(xyVirtualClock& clock, unsigned long bps=115200, unsigned long turnaroundUs=20000);
+
+    /**
+     * @brief adds a unit with slave address adr, false if the table is full or adr is known at the same rate
+     * @param baud baud rate number of the unit (tXyBaudrate), 255: the line rate
+     */
+    bool addUnit(byte adr, byte baud=255);
+    void setBaudMode(byte adr, tSimBaudMode mode);
+    /** @brief power cycle of a unit: a baud rate written with XY_SIM_BAUD_AFTER_RESET takes effect */
+    void resetUnit(byte adr);
+    /** @brief sets the charge and energy counters of a unit to 0, like the XY6020L does i.e. on a new output cycle */
+    void resetCounters(byte adr);
+    /** @brief exact charge and energy since the start of the unit, in 0.001 Ah / 0.001 Wh, without counter resets */
+    double getCharge(byte adr);
+    double getEnergy(byte adr);
+    /** @brief holding registers / preset memory of a unit, nullptr if unknown */
+    word* getRegs(byte adr);
+    word* getMem(byte adr, byte nr);
+
+    /** @brief line rate of the UART, i.e. as set baud rate callback of xyBus */
+    void setBaud(unsigned long bps);
+    /** @brief random addition to the turnaround time: 0..us, deterministic sequence */
+    void setJitter(unsigned long us) { mJitter = us; };
+    /** @brief each n-th answer is delayed by us in addition, 0: off */
+    void setLate(word every, unsigned long us) { mLateEvery = every; mLateUs = us; };
+
+    int available(void);
+    int read(void);
+    int peek(void);
+    size_t write(uint8_t c) { return write(&c, 1); };
+    size_t write(const uint8_t* pBuf, size_t size);
+    using Print::write;
+
+    /// @name statistics
+    /// @{
+    unsigned long getNbRequests(void) { return mNbRequests; };
+    unsigned long getNbCollisions(void) { return mNbCollisions; };
+    unsigned long getNbLate(void) { return mNbLate; };
+    /// @}
+
+  private:
+    typedef struct {
+        byte Adr;
+        /** @brief rate the unit listens at, in bits per second */
+        unsigned long Bps;
+        tSimBaudMode BaudMode;
+        /** @brief time of the last counter update, in us of the virtual clock */
+        unsigned long long TCnt;
+        /** @brief counter fractions: 0.01 A x us and 0.0001 W x us */
+        unsigned long long QAcc;
+        unsigned long long EAcc;
+        /** @brief totals since start in the same units */
+        unsigned long long QTotal;
+        unsigned long long ETotal;
+        word Regs[NB_HREGS];
+        word Mem[XY_SIM_NB_MEMORIES][NB_MEMREGS];
+    } tSimUnit;
+
+    typedef struct {
+        unsigned char Data[XY_SIM_FRAME_SIZE];
+        byte          Len;
+        byte          Pos;
+        /** @brief begin of the first byte on the line, in us of the virtual clock */
+        unsigned long long Start;
+    } tSimFrame;
+
+    xyVirtualClock* mClock;
+    unsigned long mBps;
+    unsigned long mByteUs;
+    unsigned long mTurnaround;
+    unsigned long mJitter;
+    word          mLateEvery;
+    unsigned long mLateUs;
+    uint32_t      mRandom;
+
+    tSimUnit      mUnits[XY_SIM_MAX_UNITS];
+    byte          mNbUnits;
+    tSimFrame     mFrames[XY_SIM_MAX_FRAMES];
+    byte          mNbFrames;
+
+    unsigned long mNbRequests;
+    unsigned long mNbCollisions;
+    unsigned long mNbLate;
+
+    /** @brief unit with slave address adr at the line rate, any rate with anyRate */
+    tSimUnit* FindUnit(byte adr, bool anyRate=true);
+    /** @brief answers a valid request, returns the answer length, 0: no answer */
+    byte Answer(tSimUnit* pUnit, const uint8_t* pReq, size_t len, unsigned char* pAns);
+    /** @brief integrates ACT_C / ACT_P since the last update into the charge and energy counters */
+    void Count(tSimUnit* pUnit);
+    void DropFrame(byte idx);
+    /** @brief bytes of the first frame on the line till now */
+    byte Arrived(void);
+};
+#endif
@@ -27,8 +27,12 @@
 
 /** @brief period for reading content of all hold regs, in msec  */
 // #define PERIOD_READ_ALL_HREGS 100
-/** @brief answer timeout of tx message: 4 x 10 ms */
-#define PERIOD_TIMEOUT_RESPONSE 4 
+/** @brief answer timeout of tx message in addition to the frame times, in us */
+#define PERIOD_TIMEOUT_RESPONSE 50000UL
+/** @brief wait time for the next byte of an answer, in us */
+#define RX_BYTE_PAUSE 1000
+/** @brief internal watchdog reaction step: CC part of the rollback */
+#define XY6020_WD_ROLLBACK_CC 0x80
 
 TxRingBuffer::TxRingBuffer()
 {
@@ -89,30 +93,144 @@ bool TxRingBuffer::GetTx(txRingEle& TxEle)
 }
 
 
-xy6020l::xy6020l(Stream& serial, byte adr, byte txPeriod, byte options )
+xyPort::xyPort(Stream& serial, byte txPeriod, xyClock* pClock)
 {
-  mSerial= &serial;
+  mSerial = &serial;
+  mClock = pClock != nullptr ? pClock : &xyClock::Default();
+  mTxPeriod = txPeriod;
+  mTLastTx = mClock->micros();
+  setLineRate(115200);
+  mpOwner = nullptr;
+  mNbDrivers = 0;
+  mTurn = 0;
+  mHold = false;
+}
+
+void xyPort::Add(xy6020l* pXy)
+{
+  byte i;
+  // reuse the slot of a removed instance
+  for(i=0; i < mNbDrivers; i++)
+  {
+    if( mpDrivers[i] == nullptr )
+    {
+      mpDrivers[i] = pXy;
+      return;
+    }
+  }
+  if( mNbDrivers < XY_PORT_MAX_DRIVERS )
+    mpDrivers[mNbDrivers++] = pXy;
+}
+
+void xyPort::Remove(xy6020l* pXy)
+{
+  for(byte i=0; i < mNbDrivers; i++)
+  {
+    if( mpDrivers[i] == pXy )
+    {
+      mpDrivers[i] = nullptr;
+    }
+  }
+  if( mpOwner == pXy )
+    mpOwner = nullptr;
+}
+
+bool xyPort::Grant(xy6020l* pXy)
+{
+  byte i, idx;
+  xy6020l* pNext;
+
+  if( mHold || (mpOwner != nullptr) )
+    return false;
+  // first instance with a prepared frame from the one whose turn it is
+  for(i=0; i < mNbDrivers; i++)
+  {
+    idx = (mTurn + i) % mNbDrivers;
+    pNext = mpDrivers[idx];
+    if( (pNext != nullptr) && (pNext->mTxBufIdx > 0) )
+    {
+      if( pNext != pXy )
+        return false;
+      mTurn = (idx + 1) % mNbDrivers;
+      return true;
+    }
+  }
+  // more instances than slots
+  return true;
+}
+
+xy6020l::xy6020l(Stream& serial, byte adr, byte txPeriod, byte options, xyClock* pClock ) :
+  mOwnPort(serial, txPeriod, pClock)
+{
+  mpPort = &mOwnPort;
+  Init(adr, options);
+}
+
+xy6020l::xy6020l(xyPort& port, byte adr, byte options) :
+  mOwnPort(port.getSerial(), port.getTxPeriod(), &port.getClock())
+{
+  mpPort = &port;
+  Init(adr, options);
+}
+
+xy6020l::~xy6020l()
+{
+  mpPort->Remove(this);
+}
+
+void xy6020l::Init(byte adr, byte options)
+{
+  mpPort->Add(this);
+  mSerial = mpPort->mSerial;
+  mClock = mpPort->mClock;
   mAdr=adr;
   mOptions = options;
-  mMemory = 255;
+  mMemNr = 255;
   mMemoryState= Send;
   mRxBufIdx =  0;
   mRxFrameCnt=0; 
   mRxFrameCntLast=0;
   mTxBufIdx =  0;
-  mTxPeriod  = txPeriod;
-  mResponse = None;
-  mTs = millis();
-  mTO = mTs;
-  mTLastTx = mTs;
-};
+  mPrioPending = false;
+  mTrans.Active = false;
+  mRxDiscarded = 0;
+  mLastExceptionCode = 0;
+  mRttUs = 0;
+  mTLastTx = mClock->micros();
+  mTRx = mClock->millis();
+  mTRxValid = false;
+  memset(hRegs, 0, sizeof(hRegs));
+  memset(mMem, 0, sizeof(mMem));
+  mWdPeriod = 0;
+  mWdReaction = 0;
+  mWdCb = nullptr;
+  mWdReact = 0;
+  mWdLast = mTLastTx;
+  mWdCleanTx = mTLastTx;
+  mWdTripped = false;
+  mWdLastPoll = false;
+  mWdGoodCV = 0;
+  mWdGoodCC = 0;
+  mWdTrips = 0;
+  mWdLatMin = 0;
+  mWdLatMax = 0;
+  mWdLatSum = 0;
+}
+
+void xy6020l::setWatchdog(word period, byte reaction, tProtectCallback cb)
+{
+  mWdPeriod = period;
+  mWdReaction = reaction;
+  mWdCb = cb;
+  mWdLast = mClock->micros();
+}
 
 bool xy6020l::ReadAllHRegs(void)
 {
   bool retValue=false;
   if( mTxBufIdx == 0 )
   {
-    SendReadHReg(0, NB_HREGS-1 );  
+    SendReadHReg(0, NB_HREGS_READ );  
     retValue= true;
   }
   return retValue;
@@ -136,35 +254,29 @@ bool xy6020l::RxDecode03( byte cnt)
 
   char tmpBuf[30];
 
-  mRxThis = mRxBuf[0]==mAdr? true:false;
-  mRxSize = mRxBuf[2];
-  if (mRxSize > NB_HREGS*2+5) 
+  // destination and range from the transaction record, the answer is checked against it
+  for(word i=0; (i < mTrans.Cnt) && (i < mTrans.DstSize); i++)
+    mTrans.pDst[i]= (word)mRxBuf[3+2*i] * 256 + (word)mRxBuf[4+2*i];
+  if( mTrans.MemNr != 255 )
+    mMemNr = mTrans.MemNr;
+  // time stamp of actual values
+  if( RxCovers(HREG_IDX_ACT_V) && RxCovers(HREG_IDX_ACT_C) )
   {
-    RxOk= false;
+    mTRx = mClock->millis();
+    mTRxValid = true;
   }
-  else
-  {
-    for(int i=0; i< mRxSize/2; i++)
-    {
-      if(mMemory > 10 )
-      {
-        hRegs[i]= (word)mRxBuf[3+2*i] * 256 + (word)mRxBuf[4+2*i];
-      }
-      else
-      {
-        mMem[i]= (word)mRxBuf[3+2*i] * 256 + (word)mRxBuf[4+2*i];
-      }
-    }
-  };
-  // ignore CRC
-  mRxFrameCnt++;
+  // short watchdog reads are no HReg update for the application
+  if( !( (mTrans.Start == HREG_IDX_PROTECT) && (mTrans.Cnt == XY6020_WD_NB_REGS) ) )
+    mRxFrameCnt++;
+  if( RxCovers(HREG_IDX_PROTECT) )
+    WdCheck();
   
   #if __debug__ > 2  
   sprintf( tmpBuf, "\nDec03:%d: ", mRxBuf[1]);
   Serial.print(tmpBuf);
   #endif
   #if __debug__ > 2  
-  if(mMemory > 10 )
+  if(mTrans.MemNr == 255 )
   {
     for(int i=0; i < NB_HREGS; i++)
     {
@@ -183,10 +295,6 @@ bool xy6020l::RxDecode03( byte cnt)
   Serial.print("\n");
   #endif
 
-  // reset memory redirection
-  mMemory=255;
-  
-  mResponse = None;
   return RxOk;
 }
 
@@ -196,7 +304,6 @@ bool xy6020l::RxDecode06( byte cnt)
   word RegNr;
   char tmpBuf[30];
 
-  mRxThis = mRxBuf[0]==mAdr? true:false;
   if(mRxBuf[1]==0x06)
   {
     RegNr = (word)mRxBuf[2] *256 + mRxBuf[3];
@@ -211,7 +318,6 @@ bool xy6020l::RxDecode06( byte cnt)
   Serial.print(tmpBuf);
   #endif
 
-  mResponse = None;
   return RxOk;
 }
 
@@ -221,7 +327,6 @@ bool xy6020l::RxDecode16( byte cnt)
   word RegNr;
   char tmpBuf[30];
 
-  mRxThis = mRxBuf[0]==mAdr? true:false;
   if(mRxBuf[1]==0x10)
   {
     RegNr = (word)mRxBuf[2] *256 + mRxBuf[3];
@@ -232,7 +337,6 @@ bool xy6020l::RxDecode16( byte cnt)
   Serial.print(tmpBuf);
   #endif
 
-  mResponse = None;
   return RxOk;
 }
 
@@ -243,9 +347,6 @@ void xy6020l::RxDecodeExceptions(byte cnt)
   if(cnt >= 5)
   {
     mLastExceptionCode = mRxBuf[2];
-    // reset memory redirection
-    mMemory=255;
-    mResponse = None;
 
     #if __debug__ > 2  
     sprintf( tmpBuf, "\nException to fct code %d", ( mRxBuf[1] & 0x0F) );
@@ -271,15 +372,19 @@ void xy6020l::RxDecodeExceptions(byte cnt)
 void xy6020l::task()
 {
   char tmpBuf[30];
+  uint32_t now, deadline;
+  int rx;
+  byte nbRx = 0;
 
-  mRxBufIdx=0;
-  // check rx buffer
+  // check rx buffer, the answer of the open transaction may arrive over several calls
+  // on a shared port only the sender reads, bytes without open request are drained by any instance
   #if __debug__ > 9  
   if(mSerial->available() > 0)
     Serial.print("\nRX: ");
   #endif
 
-  while ( (mSerial->available() > 0) && (mRxBufIdx < sizeof(mRxBuf)) ) 
+  while ( ( (mpPort->mpOwner == this) || (mpPort->mpOwner == nullptr) ) &&
+          (mSerial->available() > 0) && (mRxBufIdx < sizeof(mRxBuf)) ) 
   {
     mRxBuf[ mRxBufIdx] = mSerial->read();
 
@@ -289,101 +394,299 @@ void xy6020l::task()
     #endif
 
     mRxBufIdx++;
+    nbRx++;
     // @todo optimize delay time in dependency from baudrate
-    delayMicroseconds(1000);
+    mClock->delayMicroseconds(RX_BYTE_PAUSE);
   }
-  if(mRxBufIdx > 7)
+  now = mClock->micros();
+  if(mRxBufIdx > 0)
   {
-    if(mRxBuf[1] & 0x80)
-      RxDecodeExceptions(mRxBufIdx);
-    else
+    rx = RxMatch();
+    // late answer of a timed out request, other slave or noise: drop it, the answer may follow in the same bytes
+    while(rx < 0)
     {
-      // mbus as different answer layouts
-      switch(mRxBuf[1] )
+      RxDrop();
+      rx = (mRxBufIdx > 0) ? RxMatch() : 0;
+    }
+    if(rx > 0)
+    {
+      // round trip time of the answered tx message
+      mRttUs = now - mTrans.TxTime;
+      if(mRxBuf[1] & 0x80)
+      {
+        RxDecodeExceptions(mRxBufIdx);
+        // dummy increment frame counter to release any blocked waiting loop, like a timeout
+        mRxFrameCnt++;
+      }
+      else
       {
-        case 0x3: RxDecode03(mRxBufIdx); break;
-        case 0x6: RxDecode06(mRxBufIdx); break;
-        case 0x10:RxDecode16(mRxBufIdx); break;
+        // mbus as different answer layouts
+        switch(mRxBuf[1] )
+        {
+          case 0x3: RxDecode03(mRxBufIdx); break;
+          case 0x6: RxDecode06(mRxBufIdx); break;
+          case 0x10:RxDecode16(mRxBufIdx); break;
+        }
       }
+      mTrans.Active = false;
+      mpPort->mpOwner = nullptr;
+      mRxBufIdx = 0;
+    }
+    else if( (nbRx > 0) && (mRxBufIdx > 0) )
+    {
+      // answer still arriving: time for the missing bytes
+      deadline = now + (uint32_t)(mTrans.RxLen > mRxBufIdx ? mTrans.RxLen - mRxBufIdx : 0) * mpPort->mByteUs + PERIOD_TIMEOUT_RESPONSE;
+      if( (int32_t)(deadline - mTrans.Deadline) > 0 )
+        mTrans.Deadline = deadline;
     }
   }
   // transmits pending ?
-  if(mResponse== None)
+  if( !mTrans.Active )
   {
     // response received -> tx next after pause time
-    // transmit pause time:  mTxPeriod ms !
-    if (millis() > mTLastTx + mTxPeriod) 
+    // transmit pause time:  tx period of the port, no other instance waiting for its answer
+    if( (mpPort->mpOwner == nullptr) && xyClock::Elapsed(now, mpPort->mTLastTx, (unsigned long)mpPort->mTxPeriod * 1000UL) )
     {
-      // something in the txbuffer ?  -> send Tx data out
+      // something in the txbuffer ?  -> send Tx data out, in turn with the other instances on the port
       if(mTxBufIdx > 0)
       {
+        if( mpPort->Grant(this) )
+        {
 
-          #if __debug__ > 9  
-          Serial.print("Send bytes: ");
-          for(int i=0; i < mTxBufIdx; i++)
-          {
-            sprintf( tmpBuf, "%02X ",mTxBuf[i] );
-            Serial.print(tmpBuf);
-          }
-          Serial.print("\n");
-          #endif
-
-        mSerial->write( mTxBuf, mTxBufIdx);
-        mTxBufIdx=0;
-        mResponse = Data;
-        mTLastTx = millis();  // wait from here PERIOD_TX_PAUSE for next transmits 
-        #if __debug__ > 2  
-        Serial.print("Tx Buf send\n");
-        #endif
+            #if __debug__ > 9  
+            Serial.print("Send bytes: ");
+            for(int i=0; i < mTxBufIdx; i++)
+            {
+              sprintf( tmpBuf, "%02X ",mTxBuf[i] );
+              Serial.print(tmpBuf);
+            }
+            Serial.print("\n");
+            #endif
 
+          OpenTransaction(now);
+          mSerial->write( mTxBuf, mTxBufIdx);
+          mTxBufIdx=0;
+          mTLastTx = now;
+          mpPort->mTLastTx = now;  // wait from here tx period for next transmits 
+          // the answer belongs to this instance, broadcasts have none
+          if( mTrans.Active )
+            mpPort->mpOwner = this;
+          #if __debug__ > 2  
+          Serial.print("Tx Buf send\n");
+          #endif
+        }
       }
       else
       {
         // prioritize queued register writes against updating Hregs 
 
+        // protection trip reaction first
+        if( mWdReact )
+        {
+          WdReact();
+        }
+        // priority write, i.e. fallback of a group write
+        else if( mPrioPending )
+        {
+          if( setHReg(mPrioIdx, mPrioValue) )
+            mPrioPending = false;
+        }
+        // watchdog poll due ? interleaved with other traffic
+        else if( (mWdPeriod > 0) && xyClock::Elapsed(now, mWdLast, (unsigned long)mWdPeriod * 1000UL) &&
+                 ( !mWdLastPoll || ( mTxRingBuffer.IsEmpty() && (mOptions & XY6020_OPT_NO_HREG_UPDATE) ) ) )
+        {
+          mWdLast = now;
+          mWdLastPoll = true;
+          SendReadHReg(HREG_IDX_PROTECT, XY6020_WD_NB_REGS);
+        }
         // any command queued ?
-        if( !mTxRingBuffer.IsEmpty() ) 
+        else if( !mTxRingBuffer.IsEmpty() ) 
         {
+          mWdLastPoll = false;
           setHRegFromBuf();
         }
         else 
         {
           // update all HReg 
           if(!(mOptions & XY6020_OPT_NO_HREG_UPDATE))
-            SendReadHReg(0, NB_HREGS-1 );
-
+          {
+            mWdLastPoll = false;
+            SendReadHReg(0, NB_HREGS_READ );
+          }
         }
       }
     }
   }
 
   // answer timeout detection
-  if (millis() > mTO + 10) 
+  if( mTrans.Active && xyClock::Reached(mClock->micros(), mTrans.Deadline) )
   {
-    mTO = millis();
-    if(mResponse == None)
-      mCntTO= PERIOD_TIMEOUT_RESPONSE;
-    else
-    {
-      if(mCntTO>0) 
-        mCntTO--;
-      else
-      {
-        // TIME OUT
-        #if __debug__ > 1 
-        Serial.print(F("\n\n - -  TIMEOUT - - *********************************************************************************************************\n"));
-        //delay(10000);
-        #endif
-        mResponse= None;
-        // reset memory redirection
-        mMemory=255;
-        // dummy increment frame counter to release any blocked waiting loop
-        mRxFrameCnt++;
-      };
-    }
+    // TIME OUT
+    #if __debug__ > 1 
+    Serial.print(F("\n\n - -  TIMEOUT - - *********************************************************************************************************\n"));
+    //delay(10000);
+    #endif
+    // a later answer is discarded
+    mTrans.Active = false;
+    mpPort->mpOwner = nullptr;
+    mRxBufIdx = 0;
+    // dummy increment frame counter to release any blocked waiting loop
+    mRxFrameCnt++;
   }
 };
 
+bool xy6020l::SendBroadcast(byte hRegIdx, word value)
+{
+  bool retVal=false;
+  unsigned char txBuf[8];
+  word crc;
+
+  if( mpPort->IsIdle() )
+  {
+    txBuf[0]= 0;
+    txBuf[1]= 0x06;
+    txBuf[2]= 0;
+    txBuf[3]= hRegIdx;
+    txBuf[4]= value >> 8;
+    txBuf[5]= value & 0xFF;
+    crc = CRC(txBuf, 6);
+    txBuf[6]= (byte)(crc & 0xFF);
+    txBuf[7]= (byte)(crc >> 8);
+    // send at once, a prepared frame in mTxBuf follows after the pause time
+    mSerial->write( txBuf, 8);
+    mTLastTx = mClock->micros();
+    mpPort->mTLastTx = mTLastTx;
+    mpPort->mHold = false;
+    retVal= true;
+  }
+  else
+    // keep the bus free: no new requests till the broadcast is sent
+    mpPort->mHold = true;
+  return retVal;
+}
+
+/** @brief creates the transaction record of the frame in mTxBuf, which is sent now */
+void xy6020l::OpenTransaction(uint32_t now)
+{
+  mTrans.Adr   = mTxBuf[0];
+  mTrans.Fct   = mTxBuf[1];
+  mTrans.Start = (word)mTxBuf[2] * 256 + mTxBuf[3];
+  mTrans.Cnt   = (word)mTxBuf[4] * 256 + mTxBuf[5];
+  mTrans.Value = 0;
+  mTrans.RxLen = 8;
+  mTrans.pDst  = nullptr;
+  mTrans.DstSize = 0;
+  mTrans.MemNr = 255;
+  switch( mTrans.Fct )
+  {
+    case 0x03:
+      mTrans.RxLen = (mTrans.Cnt < 126) ? 5 + 2 * mTrans.Cnt : 0;
+      if( mTrans.Start < NB_HREGS )
+      {
+        mTrans.pDst = &hRegs[mTrans.Start];
+        mTrans.DstSize = NB_HREGS - mTrans.Start;
+      }
+      else if( (mTrans.Start >= HREG_IDX_M0) && ((mTrans.Start - HREG_IDX_M0) % HREG_IDX_M_OFFSET == 0) )
+      {
+        // preset memory, the cache always holds a complete one
+        mTrans.pDst = mMem;
+        mTrans.DstSize = NB_MEMREGS;
+        mTrans.MemNr = (mTrans.Start - HREG_IDX_M0) / HREG_IDX_M_OFFSET;
+      }
+      break;
+    case 0x06:
+      mTrans.Value = mTrans.Cnt;
+      mTrans.Cnt = 1;
+      break;
+  }
+  mTrans.TxTime = now;
+  // frame times of request and answer + answer time of XY6020L
+  mTrans.Deadline = now + (uint32_t)(mTxBufIdx + mTrans.RxLen) * mpPort->mByteUs + PERIOD_TIMEOUT_RESPONSE;
+  // no answer to broadcasts
+  mTrans.Active = (mTrans.Adr != 0);
+}
+
+/**
+ * @brief checks the received bytes against the open transaction: slave address, function, register range and CRC
+ * @return 1: complete answer, 0: waiting for more bytes, -1: no answer to the open transaction
+ */
+int xy6020l::RxMatch(void)
+{
+  byte len;
+  word crc;
+
+  if( !mTrans.Active || (mRxBuf[0] != mTrans.Adr) )
+    return -1;
+  if( mRxBufIdx < 3 )
+    return 0;
+  if( (mRxBuf[1] & 0x7F) != mTrans.Fct )
+    return -1;
+  // read answer of another request, i.e. of a timed out one
+  if( (mRxBuf[1] == 0x03) && (mRxBuf[2] != 2 * mTrans.Cnt) )
+    return -1;
+
+  len = (mRxBuf[1] & 0x80) ? 5 : mTrans.RxLen;
+  if( (len < 5) || (len > sizeof(mRxBuf)) )
+    return -1;
+  if( mRxBufIdx < len )
+    return 0;
+  crc = CRC(mRxBuf, len - 2);
+  if( (mRxBufIdx > len) || (mRxBuf[len-2] != (crc & 0xFF)) || (mRxBuf[len-1] != (crc >> 8)) )
+    return -1;
+
+  // write answers echo register and value / number of registers
+  if( (mRxBuf[1] == 0x06) || (mRxBuf[1] == 0x10) )
+  {
+    if( ((word)mRxBuf[2] * 256 + mRxBuf[3]) != mTrans.Start ||
+        ((word)mRxBuf[4] * 256 + mRxBuf[5]) != (mRxBuf[1] == 0x06 ? mTrans.Value : mTrans.Cnt) )
+      return -1;
+  }
+  return 1;
+}
+
+/**
+ * @brief drops the first frame of the rx buffer: a complete one with valid CRC at once,
+ *        else the bytes up to the next one with the slave address of the open transaction
+ */
+void xy6020l::RxDrop(void)
+{
+  byte len = 0, n;
+  word crc;
+
+  #if __debug__ > 1 
+  Serial.print(F("\n - -  RX DISCARDED - -\n"));
+  #endif
+  if( mRxBufIdx >= 3 )
+  {
+    if( mRxBuf[1] & 0x80 )
+      len = 5;
+    else if( mRxBuf[1] == 0x03 )
+      len = 5 + mRxBuf[2];
+    else if( (mRxBuf[1] == 0x06) || (mRxBuf[1] == 0x10) )
+      len = 8;
+  }
+  if( (len < 5) || (len > mRxBufIdx) )
+    len = 0;
+  else
+  {
+    crc = CRC(mRxBuf, len - 2);
+    if( (mRxBuf[len-2] != (crc & 0xFF)) || (mRxBuf[len-1] != (crc >> 8)) )
+      len = 0;
+  }
+  n = len;
+  if( n == 0 )
+  {
+    n = 1;
+    while( mTrans.Active && (n < mRxBufIdx) && (mRxBuf[n] != mTrans.Adr) )
+      n++;
+    if( !mTrans.Active )
+      n = mRxBufIdx;
+  }
+  mRxDiscarded++;
+  mRxBufIdx -= n;
+  memmove(mRxBuf, &mRxBuf[n], mRxBufIdx);
+}
+
 void xy6020l::SendReadHReg( word startReg, word nbRegs)
 {
   // tx buffer free?
@@ -400,11 +703,81 @@ void xy6020l::SendReadHReg( word startReg, word nbRegs)
   }
 }
 
+/** @brief checks the protect register after a read answer, triggers callback and reaction on a trip */
+void xy6020l::WdCheck(void)
+{
+  word latency;
+  uint32_t now = mClock->micros();
+
+  if( hRegs[HREG_IDX_PROTECT] == 0 )
+  {
+    // no protection: keep setpoints for rollback, only from answers which contain them
+    mWdCleanTx = mTLastTx;
+    mWdTripped = false;
+    if( mTrans.Start == 0 )
+    {
+      mWdGoodCV = hRegs[HREG_IDX_CV];
+      mWdGoodCC = hRegs[HREG_IDX_CC];
+    }
+  }
+  else if( !mWdTripped )
+  {
+    // new trip: the protection occured between the last clean read request and now
+    latency = (now - mWdCleanTx) / 1000 > 0xFFFF ? 0xFFFF : (word)( (now - mWdCleanTx) / 1000 );
+    mWdTripped = true;
+    if( mWdTrips == 0 || latency < mWdLatMin )
+      mWdLatMin = latency;
+    if( latency > mWdLatMax )
+      mWdLatMax = latency;
+    mWdLatSum += latency;
+    mWdTrips++;
+
+    #if __debug__ > 1 
+    Serial.print(F("\n - -  PROTECTION TRIP - -\n"));
+    #endif
+
+    if( mWdReaction )
+    {
+      mWdReact = mWdReaction;
+      // pending read request is dropped in favour of the reaction
+      if( (mTxBufIdx > 0) && (mTxBuf[1] == 0x03) )
+      {
+        mTxBufIdx = 0;
+        // release any blocked waiting loop
+        mRxFrameCnt++;
+      }
+    }
+    if( mWdCb != nullptr )
+      mWdCb( hRegs[HREG_IDX_PROTECT], latency );
+  }
+}
+
+/** @brief sends the next pending trip reaction, bypassing the tx ring buffer */
+void xy6020l::WdReact(void)
+{
+  if( mWdReact & XY6020_WD_OUTPUT_OFF )
+  {
+    if( setHReg(HREG_IDX_OUTPUT_ON, 0) )
+      mWdReact &= ~XY6020_WD_OUTPUT_OFF;
+  }
+  else if( mWdReact & XY6020_WD_ROLLBACK )
+  {
+    // CV first, CC with next slot
+    if( setHReg(HREG_IDX_CV, mWdGoodCV) )
+      mWdReact = (mWdReact & ~XY6020_WD_ROLLBACK) | XY6020_WD_ROLLBACK_CC;
+  }
+  else if( mWdReact & XY6020_WD_ROLLBACK_CC )
+  {
+    if( setHReg(HREG_IDX_CC, mWdGoodCC) )
+      mWdReact &= ~XY6020_WD_ROLLBACK_CC;
+  }
+}
+
 void xy6020l::SetMemory(tMemory& mem )
 {
   if( mem.Nr<10)
   {
-    mMemory= mem.Nr;
+    mMemNr = mem.Nr;
     /** @todo:  check memcpy for fast copy */
     mMem[HREG_IDX_M_VSET] = mem.VSet;
     mMem[HREG_IDX_M_ISET] = mem.ISet;
@@ -432,16 +805,19 @@ bool xy6020l::GetMemory(tMemory* pMem)
   switch(mMemoryState)
   {
     case Send:
-      if(pMem!= nullptr && (pMem->Nr < 10) )
+      // tx buffer free?
+      if(pMem!= nullptr && (pMem->Nr < 10) && (mTxBufIdx == 0) )
       {
-        mMemory= pMem->Nr;
+        // cache content invalid till answer
+        mMemNr = 255;
         SendReadHReg( HREG_IDX_M0 + pMem->Nr * HREG_IDX_M_OFFSET, NB_MEMREGS);
         mMemoryState = Wait;
         mMemoryLastFrame= mRxFrameCnt;
       }
       break;
     case Wait:
-      if( mMemoryLastFrame != mRxFrameCnt)
+      // answer of the memory read
+      if( mMemNr == pMem->Nr )
       {
         // 
         pMem->VSet = mMem[HREG_IDX_M_VSET];
@@ -457,16 +833,31 @@ bool xy6020l::GetMemory(tMemory* pMem)
         pMem->sOTP = mMem[HREG_IDX_M_SOTP];
         pMem->sINI = mMem[HREG_IDX_M_SINI];        
 
-        mMemory = 255;
         mMemoryState= Send;
         retVal = true;
       }
+      // lost: timeout, exception or read dropped by the watchdog -> read again with the next call
+      else if( (mMemoryLastFrame != mRxFrameCnt) && (mTxBufIdx == 0) && !(mTrans.Active && (mTrans.MemNr == pMem->Nr)) )
+        mMemoryState= Send;
       break;
   }
   return retVal;
 }
 
 
+bool xy6020l::QueueHRegPrio(byte idx, word value)
+{
+  bool retVal=false;
+  if( !mPrioPending && (idx < NB_HREGS) )
+  {
+    mPrioIdx = idx;
+    mPrioValue = value;
+    mPrioPending = true;
+    retVal = true;
+  }
+  return retVal;
+}
+
 bool xy6020l::setHReg(byte nr, word value)
 {
   bool retVal=false;
@@ -532,12 +923,12 @@ bool xy6020l::setHRegFromBuf()
   return (retVal);
 }
 
-void xy6020l::CRCModBus(int datalen)
+word xy6020l::CRC(const unsigned char* pBuf, int len)
 {
   word crc = 0xFFFF;
-  for (int pos = 0; pos < datalen; pos++)
+  for (int pos = 0; pos < len; pos++)
   {
-      crc ^= mTxBuf[pos];
+      crc ^= pBuf[pos];
 
       for (int i = 8; i != 0; i--)
       {
@@ -550,10 +941,34 @@ void xy6020l::CRCModBus(int datalen)
               crc >>= 1;
       }
   }
+  return crc;
+}
+
+void xy6020l::CRCModBus(int datalen)
+{
+  word crc = CRC(mTxBuf, datalen);
   mTxBuf[datalen] = (byte)(crc & 0xFF);
   mTxBuf[datalen + 1] = (byte)((crc >> 8) & 0xFF);
 }
 
+unsigned long xy6020l::BaudToRate( byte rate)
+{
+  unsigned long bps=0;
+  switch(rate)
+  {
+    case XY_BAUD_9600:   bps=9600; break;
+    case XY_BAUD_14400:  bps=14400; break;
+    case XY_BAUD_19200:  bps=19200; break;
+    case XY_BAUD_38400:  bps=38400; break;
+    case XY_BAUD_56000:  bps=56000; break;
+    case XY_BAUD_57600:  bps=57600; break;
+    case XY_BAUD_115200: bps=115200; break;
+    case XY_BAUD_2400:   bps=2400; break;
+    case XY_BAUD_4800:   bps=4800; break;
+  }
+  return bps;
+}
+
 bool xy6020l::setSlaveAdd( word add) 
 { 
   bool retVal= true;
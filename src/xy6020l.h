@@ -23,9 +23,12 @@
 #define xy6020l_h
 
 #include "Arduino.h"
+#include "xy6020l_clock.h"
 
 // the XY6020 provides 31 holding registers
 #define NB_HREGS 31
+// registers read by ReadAllHRegs and the automatic update: 0 .. HREG_IDX_MEMORY
+#define NB_HREGS_READ (NB_HREGS-1)
 #define NB_MEMREGS 14
 
 // Holding Register index
@@ -89,6 +92,20 @@
 #define HREG_IDX_M_SINI  13
 
 
+/** @brief baud rate numbers of HREG_IDX_BAUDRATE */
+typedef enum {
+  XY_BAUD_9600 = 0,
+  XY_BAUD_14400 = 1,
+  XY_BAUD_19200 = 2,
+  XY_BAUD_38400 = 3,
+  XY_BAUD_56000 = 4,
+  XY_BAUD_57600 = 5,
+  XY_BAUD_115200 = 6,
+  XY_BAUD_2400 = 7,
+  XY_BAUD_4800 = 8,
+  XY_BAUD_NB
+} tXyBaudrate;
+
 #define TX_RING_BUFFER_SIZE 16
 typedef struct {
   byte mHregIdx;
@@ -106,11 +123,89 @@ class TxRingBuffer
     TxRingBuffer();
     bool IsEmpty() { return (mIn<1);};
     bool IsFull() { return (mIn>=TX_RING_BUFFER_SIZE);}
+    int  getFree() { return TX_RING_BUFFER_SIZE - mIn;}
     bool AddTx(txRingEle* pTxEle);
     bool AddTx(byte hRegIdx, word value);
     bool GetTx(txRingEle& pTxEle);
 };
 
+class xy6020l;
+
+#define XY_PORT_MAX_DRIVERS 8
+
+/**
+ * @class xyPort
+ * @brief Serial port of one bus, shared by the xy6020l instances of all units on it
+ *
+ * Only one instance has a request open at a time and the tx pause applies to the whole bus.
+ * The instances take turns in sending (round robin), only the sender reads the answer.
+ * Bytes without open request (late answers) are drained by any instance.
+ */
+class xyPort
+{
+  public:
+    /**
+     * @param serial Stream object reference (i.e., Serial1)
+     * @param txPeriod minimum period between 2 tx messages on the bus, in ms
+     * @param pClock time base of all instances on the port, nullptr: Arduino millis()/micros()
+     */
+    xyPort(Stream& serial, byte txPeriod=50, xyClock* pClock=nullptr);
+
+    Stream& getSerial(void) { return *mSerial; };
+    xyClock& getClock(void) { return *mClock; };
+    byte getTxPeriod(void) { return mTxPeriod; };
+    /** @brief true if no answer is outstanding and the tx pause is over */
+    bool IsIdle(void) { return (mpOwner == nullptr) && xyClock::Elapsed(mClock->micros(), mTLastTx, (unsigned long)mTxPeriod * 1000UL); };
+    /** @brief restarts the tx pause time */
+    void PauseTx(void) { mTLastTx = mClock->micros(); };
+    /** @brief line rate in bits per second, the answer timeout includes the frame times, default 115200 */
+    void setLineRate(unsigned long bps) { mByteUs = bps > 0 ? 10000000UL / bps : 0; };
+
+  private:
+    friend class xy6020l;
+    Stream*       mSerial;
+    xyClock*      mClock;
+    byte          mTxPeriod;
+    /** @brief tx time of the last frame on the bus, in us */
+    uint32_t      mTLastTx;
+    /** @brief time of 1 byte (10 bits) at the line rate, in us */
+    uint32_t      mByteUs;
+    /** @brief instance waiting for its answer, nullptr: none */
+    xy6020l*      mpOwner;
+    xy6020l*      mpDrivers[XY_PORT_MAX_DRIVERS];
+    byte          mNbDrivers;
+    /** @brief next instance of the round robin */
+    byte          mTurn;
+    /** @brief a broadcast waits for the idle bus, no new requests meanwhile */
+    bool          mHold;
+
+    void Add(xy6020l* pXy);
+    void Remove(xy6020l* pXy);
+    /** @brief true if pXy may send its prepared frame now */
+    bool Grant(xy6020l* pXy);
+};
+
+/** @brief transaction record of a sent request, its answer is matched against it */
+typedef struct {
+    bool          Active;
+    byte          Adr;
+    byte          Fct;
+    /** @brief first register and number of registers, fct 6: register and written value */
+    word          Start;
+    word          Cnt;
+    word          Value;
+    /** @brief expected answer length without exception */
+    byte          RxLen;
+    /** @brief tx time and answer deadline, in us: frame times at the line rate + answer time, extended while the answer arrives */
+    uint32_t      TxTime;
+    uint32_t      Deadline;
+    /** @brief destination of read data: hRegs from Start or mMem, nullptr: none */
+    word*         pDst;
+    byte          DstSize;
+    /** @brief preset memory number of a mMem read, 255 otherwise */
+    byte          MemNr;
+} tXyTransaction;
+
 typedef struct {
     byte Nr;
     word VSet;
@@ -135,6 +230,15 @@ typedef struct {
 #define XY6020_OPT_SKIP_SAME_HREG_VALUE 1
 #define XY6020_OPT_NO_HREG_UPDATE 2
 
+/** @brief watchdog reactions on a protection trip */
+#define XY6020_WD_OUTPUT_OFF 1
+#define XY6020_WD_ROLLBACK 2
+/** @brief registers polled by the watchdog: PROTECT, CVCC, OUTPUT_ON */
+#define XY6020_WD_NB_REGS 3
+
+/** @brief protection trip callback: content of the protect register and detection latency in ms */
+typedef void (*tProtectCallback)(word protect, word latency);
+
 class xy6020l 
 {
   public:
@@ -143,8 +247,16 @@ class xy6020l
      * @param serial Stream object reference (i.e., Serial1)
      * @param adr slave address of the xy device, can be change by setSlaveAdd command
      * @param txPeriod minimum period to wait for next tx message, at times < 50 ms the XY6020 does not send answers
+     * @param pClock time base, i.e. a xyVirtualClock for simulations, nullptr: Arduino millis()/micros()
+     */
+    xy6020l(Stream& serial, byte adr=1, byte txPeriod=50, byte options=XY6020_OPT_SKIP_SAME_HREG_VALUE, xyClock* pClock=nullptr );
+    /**
+     * @brief Constructor for one of several units on the same serial port
+     * @param port bus owner shared by all instances on the serial port, with tx period and time base
+     * @param adr slave address of the xy device
      */
-    xy6020l(Stream& serial, byte adr=1, byte txPeriod=50, byte options=XY6020_OPT_SKIP_SAME_HREG_VALUE );
+    xy6020l(xyPort& port, byte adr=1, byte options=XY6020_OPT_SKIP_SAME_HREG_VALUE);
+    ~xy6020l();
     /**
      * @brief Task method that must be called in loop() function of the main program cyclically.
      * It automatically triggers the reading of the Holding Registers each PERIOD_READ_ALL_HREGS ms.
@@ -157,6 +269,8 @@ class xy6020l
     bool ReadAllHRegs(void);
     /** @brief true if the Hold Regs are read after read all register command, asynchron access */
     bool HRegUpdated(void);
+    /** @brief true after the first answer with the actual values, before all HRegs read 0 */
+    bool HRegValid(void) { return mTRxValid; };
 
     /// @name XY6020L application layer: HReg register access
     /// @{
@@ -177,10 +291,10 @@ class xy6020l
     word getActC() { return (word)hRegs[ HREG_IDX_ACT_C]; };
     /** @brief actual power at output, LSB: 0.01 W, readonly  */
     word getActP() { return (word)hRegs[ HREG_IDX_ACT_P]; };
-    /** @brief actual charge from output, LSB: 0.001 Ah, readonly, with high word because not tested yet  */
-    word getCharge() { return (word)hRegs[ HREG_IDX_OUT_CHRG ]  ; };
-    /** @brief actual energy provided from output, LSB: 0.001 Wh, readonly, with high word because not tested yet  */
-    word getEnergy() { return (word)hRegs[ HREG_IDX_OUT_ENERGY ]  ; };
+    /** @brief actual charge from output, LSB: 0.001 Ah, readonly, 32 bit from low and high word  */
+    unsigned long getCharge() { return (unsigned long)hRegs[ HREG_IDX_OUT_CHRG ] | ((unsigned long)hRegs[ HREG_IDX_OUT_CHRG_HIGH ])<<16; };
+    /** @brief actual energy provided from output, LSB: 0.001 Wh, readonly, 32 bit from low and high word  */
+    unsigned long getEnergy() { return (unsigned long)hRegs[ HREG_IDX_OUT_ENERGY ] | ((unsigned long)hRegs[ HREG_IDX_OUT_ENERGY_HIGH ])<<16; };
     /** @brief actual output time, LSB: 1 h, readonly */
     word getHour() { return (word)hRegs[ HREG_IDX_ON_HOUR ]  ; };
     /** @brief actual output time, LSB: 1 min, readonly */
@@ -220,13 +334,15 @@ class xy6020l
     /** @brief returns the version number, readonly */
     word getVersion(void)  { return (word)hRegs[ HREG_IDX_VERSION ]  ; };
 
-    /** @brief slave address, R/W, take effect after reset of XY6020L !  */
+    /** @brief slave address, R/W, take effect after reset of XY6020L !  
+        the driver keeps addressing the old one, use setAdr() after the reset */
     word getSlaveAdd(void) { return (word)hRegs[ HREG_IDX_SLAVE_ADD]; };
     bool setSlaveAdd( word add);
 
-    /** @brief baud rate , W, no read option because on use  
-        @todo: provide enum for rate number to avoid random/unsupported number */
-    bool setBaudrate( word rate) { return setHReg(HREG_IDX_BAUDRATE, rate);};
+    /** @brief baud rate , W, no read option because on use  */
+    bool setBaudrate( tXyBaudrate rate) { return (rate < XY_BAUD_NB) ? setHReg(HREG_IDX_BAUDRATE, (word)rate) : false;};
+    /** @brief converts baud rate number to bits per second, 0 if unsupported */
+    static unsigned long BaudToRate( byte rate);
 
     /** @brief internal temperature offset, R/W  */
     word getTempOfs(void) { return (word)hRegs[ HREG_IDX_TEMP_OFS]; };
@@ -241,43 +357,146 @@ class xy6020l
     bool setPreset( word preset) { return setHReg(HREG_IDX_MEMORY, preset );};
     /// @}
     
-    bool TxBufEmpty(void) { return ((mTxBufIdx<=0)&&(mTxRingBuffer.IsEmpty()));};
+    /// @name raw register cache access, i.e. for gateways
+    /// @{
+    /** @brief cached holding register, 0 if idx is out of range */
+    word getHReg(byte idx) { return idx < NB_HREGS ? hRegs[idx] : 0; };
+    /** @brief queues a holding register write like setCV(), false if tx ring buffer is full */
+    bool QueueHReg(byte idx, word value) { return idx < NB_HREGS ? mTxRingBuffer.AddTx(idx, value) : false; };
+    /** @brief writes a holding register with the next tx slot of this instance, ahead of the tx ring buffer and the HReg update,
+        only a protection trip reaction goes first, false if the previous one is not sent yet */
+    bool QueueHRegPrio(byte idx, word value);
+    /** @brief free entries in the tx ring buffer */
+    int  getQueueFree(void) { return mTxRingBuffer.getFree(); };
+    /** @brief number of the preset memory in the memory cache, 255: none */
+    byte getMemNr(void) { return mMemNr; };
+    /** @brief cached memory register, see HREG_IDX_M_VSET... */
+    word getMemReg(byte idx) { return idx < NB_MEMREGS ? mMem[idx] : 0; };
+    /// @}
+
+    /** @brief slave address the driver communicates with */
+    byte getAdr(void) { return mAdr; };
+    void setAdr(byte adr) { mAdr = adr; };
+
+    /** @brief true if no answer is outstanding on the port and the tx pause is over, i.e. the bus is free for a broadcast */
+    bool IsBusIdle(void) { return mpPort->IsIdle(); };
+    /** @brief restarts the tx pause time of the port */
+    void PauseTx(void) { mpPort->PauseTx(); };
+    /** @brief line rate of the port for the answer timeout, see xyPort::setLineRate() */
+    void setLineRate(unsigned long bps) { mpPort->setLineRate(bps); };
+    /** @brief writes a holding register of all units on the bus at once (slave address 0), no answer expected
+        @return false if the bus is not idle, no instance on the port starts a new request till the broadcast is sent */
+    bool SendBroadcast(byte hRegIdx, word value);
+
+    /** @brief ModBus CRC16 of buffer, low byte first on the line */
+    static word CRC(const unsigned char* pBuf, int len);
+
+    bool TxBufEmpty(void) { return ((mTxBufIdx<=0)&&(mTxRingBuffer.IsEmpty())&&!mPrioPending);};
+    /** @brief minimum pause between 2 tx messages, in ms */
+    byte getTxPeriod(void) { return mpPort->getTxPeriod(); };
+    /** @brief time from last tx message to its answer, in ms, 0 if no answer received yet */
+    word getRtt(void) { return (word)( (mRttUs + 500) / 1000 ); };
+    /** @brief time from last tx message to its answer, in us, 0 if no answer received yet */
+    uint32_t getRttUs(void) { return mRttUs; };
+    /** @brief transaction record of the last sent request, stays till the next one is sent */
+    const tXyTransaction& getLastTx(void) { return mTrans; };
+    /** @brief received frames discarded: late answer of a timed out request, wrong slave, function, range or CRC */
+    word getRxDiscarded(void) { return mRxDiscarded; };
+    /** @brief time stamp of the last HReg read answer, in ms of getClock(), see HRegValid() */
+    uint32_t getRxTime(void) { return mTRx; };
+    /** @brief time base of the driver, for companion classes which have to use the same time */
+    xyClock& getClock(void) { return *mClock; };
+    /** @brief true if the HRegs are not polled automatically */
+    bool isNoHRegUpdate(void) { return (mOptions & XY6020_OPT_NO_HREG_UPDATE)?true:false; };
+
+    /// @name status watchdog
+    /// @{
+    /**
+     * @brief enables fast polling of the protection, CV/CC and output registers between the other traffic
+     * @param period poll period in ms, 0 = watchdog off
+     * @param reaction XY6020_WD_OUTPUT_OFF and/or XY6020_WD_ROLLBACK to the last CV/CC setpoints read without protection
+     * @param cb called immediately on a protection trip, optional
+     */
+    void setWatchdog(word period, byte reaction=0, tProtectCallback cb=nullptr);
+    /** @brief number of detected protection trips */
+    word getWdTrips(void) { return mWdTrips; };
+    /** @brief detection latency: time from the last read without protection to the trip answer, in ms */
+    word getWdLatencyMin(void) { return mWdLatMin; };
+    word getWdLatencyMax(void) { return mWdLatMax; };
+    word getWdLatencyAvg(void) { return mWdTrips>0 ? (word)(mWdLatSum / mWdTrips) : 0; };
+    /// @}
+
     void SetMemory(tMemory& mem);
+    /**
+     * @brief reads preset memory pMem->Nr, call it cyclically till it returns true
+     * @return true if pMem is filled with the answer, false while waiting and after a lost read
+     *         (timeout, exception - see getLastExceptionCode()), the next call repeats the read then
+     */
     bool GetMemory(tMemory* pMem);
     void PrintMemory(tMemory& mem);
+    /** @brief exception code of the last exception answer (i.e. 2: illegal data address), 0: none */
+    byte getLastExceptionCode(void) { return mLastExceptionCode; };
 
   private:
+    friend class xyPort;
+    /** @brief port of an instance constructed with a Stream, unused with a shared xyPort */
+    xyPort        mOwnPort;
+    xyPort*       mpPort;
     byte          mAdr;
     byte          mOptions;
     Stream*       mSerial;
+    xyClock*      mClock;
     byte          mRxBufIdx;
-    unsigned char mRxBuf[60];
+    /** @brief largest answer: all HRegs */
+    unsigned char mRxBuf[5 + 2*NB_HREGS];
     byte          mRxState;
-    bool          mRxThis;
-    byte          mRxSize;
     word          mRxFrameCnt;
     word          mRxFrameCntLast;
     byte          mLastExceptionCode;
-
-    enum          Response { None, Confirm, Data };
-    Response      mResponse;
-    /** @brief rx answer belongs to memory request data
-     *   M0..M9 -> 0..9 ;  255 no memory   */
-    byte          mMemory; 
-    long          mTs;
-    long          mTO;
-    long          mTLastTx;
-    byte          mCntTO;
-    byte          mTxPeriod;
+    word          mRxDiscarded;
+
+    /** @brief request waiting for its answer */
+    tXyTransaction mTrans;
+    /** @brief tx time of the last message, in us */
+    uint32_t      mTLastTx;
+    /** @brief time stamp of the actual values, in ms */
+    uint32_t      mTRx;
+    bool          mTRxValid;
+    uint32_t      mRttUs;
+
+    word          mWdPeriod;
+    byte          mWdReaction;
+    tProtectCallback mWdCb;
+    /** @brief reactions still to send */
+    byte          mWdReact;
+    /** @brief time of the last watchdog poll, in us */
+    uint32_t      mWdLast;
+    /** @brief tx time of the last read without protection, in us */
+    uint32_t      mWdCleanTx;
+    bool          mWdTripped;
+    /** @brief last slot was used by the watchdog -> next one for other traffic */
+    bool          mWdLastPoll;
+    word          mWdGoodCV;
+    word          mWdGoodCC;
+    word          mWdTrips;
+    word          mWdLatMin;
+    word          mWdLatMax;
+    unsigned long mWdLatSum;
 
     int           mTxBufIdx;
     unsigned char mTxBuf[40];
     TxRingBuffer  mTxRingBuffer;
+    /** @brief write of QueueHRegPrio() waiting for the next tx slot */
+    bool          mPrioPending;
+    byte          mPrioIdx;
+    word          mPrioValue;
 
     /** @brief buffer to cache hold regs after reading them at once and to check if update needed for writting regs */
     word          hRegs[NB_HREGS];
     /** @brief 1 cache for memory register */
     word          mMem[NB_MEMREGS];
+    /** @brief preset memory number of mMem content, 255 none */
+    byte          mMemNr;
     enum          MemoryState { Send, Wait };
     MemoryState   mMemoryState;
     word          mMemoryLastFrame;
@@ -286,11 +505,20 @@ class xy6020l
     bool setHRegFromBuf(void);
 
     void CRCModBus(int datalen);
+    void Init(byte adr, byte options);
+    void OpenTransaction(uint32_t now);
+    int  RxMatch(void);
+    /** @brief drops the first frame or noise of the rx buffer, keeps bytes from the next possible answer on */
+    void RxDrop(void);
+    /** @brief true if the open transaction reads HReg reg into hRegs */
+    bool RxCovers(word reg) { return (mTrans.MemNr == 255) && (mTrans.Start <= reg) && (mTrans.Start + mTrans.Cnt > reg); };
     void RxDecodeExceptions(byte cnt);
     bool RxDecode03( byte cnt);
     bool RxDecode06( byte cnt);
     bool RxDecode16( byte cnt);
     void SendReadHReg( word startReg, word nbRegs);
+    void WdCheck(void);
+    void WdReact(void);
     void setMemoryRegs(byte HRegIdx);
 };
 #endif
\ No newline at end of file
@@ -0,0 +1,298 @@
+/**
+ * @file xy6020l_bus.cpp
+ * @brief Bus discovery and baud rate change for XY6020L DCDC converters
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#include "Arduino.h"
+#include "xy6020l_bus.h"
+
+/** @brief number of probe frames before a unit is taken as lost */
+#define BUS_NB_TRIES 3
+
+xyBus::xyBus(Stream& serial, tSetBaudCallback setBaud, byte txPeriod, xyClock* pClock)
+{
+  mSerial = &serial;
+  mClock = pClock != nullptr ? pClock : &xyClock::Default();
+  mSetBaud = setBaud;
+  mTxPeriod = txPeriod;
+  mTurnaround = 40;
+  mState = Idle;
+  mNbUnits = 0;
+  mUnitIdx = 0;
+  mBaud = XY_BAUD_115200;
+  mTLastTx = mClock->micros();
+  mTO = 0;
+  mRxBufIdx = 0;
+}
+
+void xyBus::SetBaud(byte baud)
+{
+  mBaud = baud;
+  if( mSetBaud != nullptr )
+    mSetBaud( xy6020l::BaudToRate(baud) );
+}
+
+/** @brief selects next baud rate of the scan mask, false if all scanned */
+bool xyBus::NextScanBaud(void)
+{
+  while( mBaudMask != 0 )
+  {
+    byte baud = 0;
+    while( !(mBaudMask & (1 << baud)) )
+      baud++;
+    mBaudMask &= ~(1 << baud);
+    if( xy6020l::BaudToRate(baud) > 0 )
+    {
+      SetBaud(baud);
+      return true;
+    }
+  }
+  return false;
+}
+
+bool xyBus::Scan(byte adrFirst, byte adrLast, word baudMask)
+{
+  bool retVal=false;
+  if( mState == Idle && adrFirst > 0 && adrFirst <= adrLast )
+  {
+    mNbUnits = 0;
+    mAdrFirst = adrFirst;
+    mAdrLast = adrLast;
+    mBaudMask = baudMask;
+    if( NextScanBaud() )
+    {
+      mAdr = adrFirst;
+      mState = ScanTx;
+      retVal = true;
+    }
+  }
+  return retVal;
+}
+
+bool xyBus::MoveAll(tXyBaudrate baud)
+{
+  bool retVal=false;
+  byte i;
+
+  // an address conflict can not be resolved by a write to both units
+  for(i=0; i < mNbUnits; i++)
+  {
+    if( mUnits[i].Conflict )
+      return false;
+  }
+  if( mState == Idle && mNbUnits > 0 && xy6020l::BaudToRate(baud) > 0 )
+  {
+    mNewBaud = baud;
+    mRevert = false;
+    for(i=0; i < mNbUnits; i++)
+    {
+      mUnits[i].MoveFailed = false;
+      mOldBaud[i] = mUnits[i].Baud;
+    }
+    // first unit
+    mUnitIdx = 255;
+    MoveNextUnit();
+    retVal = true;
+  }
+  return retVal;
+}
+
+void xyBus::MoveNextUnit(void)
+{
+  byte i;
+
+  // a unit failed -> all or nothing: move the units already at the new rate back
+  if( !mRevert )
+  {
+    for(i=0; i < mNbUnits; i++)
+    {
+      if( mUnits[i].MoveFailed )
+      {
+        mRevert = true;
+        mUnitIdx = 255;
+        break;
+      }
+    }
+  }
+
+  // skip units already at their target rate, a unit waiting for a reset holds another one in its register
+  do
+    mUnitIdx++;
+  while( mUnitIdx < mNbUnits && mUnits[mUnitIdx].Baud == MoveTarget() && !mUnits[mUnitIdx].MovePending );
+
+  if( mUnitIdx < mNbUnits )
+  {
+    SetBaud( mUnits[mUnitIdx].Baud );
+    mState = MoveTx;
+  }
+  else
+  {
+    // done: UART at the rate of the units, the new one or after a failure the old one
+    for(i=0; i < mNbUnits && mUnits[i].MovePending; i++)
+      ;
+    SetBaud( mUnits[i < mNbUnits ? i : 0].Baud );
+    mState = Idle;
+  }
+}
+
+void xyBus::StartProbe(bool newRate)
+{
+  mProbeNew = newRate;
+  SetBaud( newRate ? MoveTarget() : mUnits[mUnitIdx].Baud );
+  mTries = BUS_NB_TRIES;
+  mState = ProbeTx;
+}
+
+/** @brief sends a read (fct 3) or write (fct 6) frame and sets the answer timeout for rxBytes */
+void xyBus::SendFrame(byte adr, byte fct, word reg, word value, byte rxBytes)
+{
+  word crc;
+  unsigned long bps = xy6020l::BaudToRate(mBaud);
+
+  // drop any noise
+  while( mSerial->available() > 0 )
+    mSerial->read();
+  mRxBufIdx = 0;
+
+  mTxBuf[0]= adr;
+  mTxBuf[1]= fct;
+  mTxBuf[2]= reg >> 8;
+  mTxBuf[3]= reg & 0xFF;
+  mTxBuf[4]= value >> 8;
+  mTxBuf[5]= value & 0xFF;
+  crc = xy6020l::CRC(mTxBuf, 6);
+  mTxBuf[6]= (byte)(crc & 0xFF);
+  mTxBuf[7]= (byte)(crc >> 8);
+  mSerial->write( mTxBuf, 8);
+
+  mTLastTx = mClock->micros();
+  // frame times of request and answer (10 bits per byte) + answer time of XY6020L
+  mTO = ( (unsigned long)(8 + rxBytes) * 10000000UL ) / bps + (unsigned long)mTurnaround * 1000UL;
+}
+
+int xyBus::RxFrame(byte rxBytes)
+{
+  int retVal = 0;
+  word crc;
+
+  while( (mSerial->available() > 0) && (mRxBufIdx < sizeof(mRxBuf)) )
+    mRxBuf[mRxBufIdx++] = mSerial->read();
+
+  if( mRxBufIdx >= rxBytes )
+  {
+    crc = xy6020l::CRC(mRxBuf, rxBytes-2);
+    if( (mRxBuf[0] == mTxBuf[0]) && (mRxBuf[1] == mTxBuf[1]) &&
+        (mRxBuf[rxBytes-2] == (crc & 0xFF)) && (mRxBuf[rxBytes-1] == (crc >> 8)) )
+      retVal = 1;
+    else
+      retVal = -1;
+  }
+  else if( xyClock::Elapsed(mClock->micros(), mTLastTx, mTO) )
+    retVal = -1;
+
+  return retVal;
+}
+
+bool xyBus::task(void)
+{
+  int rx;
+  byte i;
+  tXyUnit* pUnit = mUnitIdx < mNbUnits ? &mUnits[mUnitIdx] : nullptr;
+
+  // tx pause time
+  if( (mState == ScanTx || mState == MoveTx || mState == ProbeTx) &&
+      !xyClock::Elapsed(mClock->micros(), mTLastTx, (unsigned long)mTxPeriod * 1000UL) )
+    return true;
+
+  switch( mState )
+  {
+    case Idle:
+      break;
+
+    case ScanTx:
+      // probe: read model and version -> 9 bytes answer
+      SendFrame( mAdr, 0x03, HREG_IDX_MODEL, 2, 9);
+      mState = ScanRx;
+      break;
+    case ScanRx:
+      rx = RxFrame(9);
+      if( rx != 0 )
+      {
+        for(i=0; i < mNbUnits && mUnits[i].Adr != mAdr; i++)
+          ;
+        // found before at another rate: two units with the same address
+        if( rx > 0 && i < mNbUnits )
+          mUnits[i].Conflict = true;
+        else if( rx > 0 && mNbUnits < XY_BUS_MAX_UNITS )
+        {
+          mUnits[mNbUnits].Adr = mAdr;
+          mUnits[mNbUnits].Baud = mBaud;
+          mUnits[mNbUnits].Model = (word)mRxBuf[3] * 256 + mRxBuf[4];
+          mUnits[mNbUnits].Version = (word)mRxBuf[5] * 256 + mRxBuf[6];
+          mUnits[mNbUnits].MoveFailed = false;
+          mUnits[mNbUnits].MovePending = false;
+          mUnits[mNbUnits].Conflict = false;
+          mNbUnits++;
+        }
+        mState = ScanTx;
+        if( mAdr < mAdrLast )
+          mAdr++;
+        else if( NextScanBaud() )
+          mAdr = mAdrFirst;
+        else
+          mState = Idle;
+      }
+      break;
+
+    case MoveTx:
+      // write baud rate number, answered at the old rate
+      SendFrame( pUnit->Adr, 0x06, HREG_IDX_BAUDRATE, MoveTarget(), 8);
+      mState = MoveRx;
+      break;
+    case MoveRx:
+      // the write may be taken even without answer (lost acknowledge): find the unit before deciding
+      if( RxFrame(8) != 0 )
+        StartProbe(true);
+      break;
+
+    case ProbeTx:
+      // read baud rate register -> 7 bytes answer
+      SendFrame( pUnit->Adr, 0x03, HREG_IDX_BAUDRATE, 1, 7);
+      mState = ProbeRx;
+      break;
+    case ProbeRx:
+      rx = RxFrame(7);
+      if( rx > 0 && mProbeNew )
+      {
+        // moved
+        pUnit->Baud = MoveTarget();
+        pUnit->MovePending = false;
+        MoveNextUnit();
+      }
+      else if( rx > 0 )
+      {
+        // still at the old rate: new rate in the register -> takes effect after reset, else the write was refused
+        if( ((word)mRxBuf[3] * 256 + mRxBuf[4]) == MoveTarget() )
+          pUnit->MovePending = true;
+        else
+          pUnit->MoveFailed = true;
+        MoveNextUnit();
+      }
+      else if( rx < 0 && --mTries > 0 )
+        mState = ProbeTx;
+      else if( rx < 0 && mProbeNew && pUnit->Baud != MoveTarget() )
+        StartProbe(false);
+      else if( rx < 0 )
+      {
+        // no answer at both rates
+        pUnit->MoveFailed = true;
+        MoveNextUnit();
+      }
+      break;
+  }
+  return mState != Idle;
+}
@@ -0,0 +1,143 @@
+/**
+ * @file xy6020l_bus.h
+ * @brief Bus discovery and baud rate change for XY6020L DCDC converters
+ *
+ * Scans slave addresses and baud rates with short probe frames (read of model and version register),
+ * and moves the found units to a higher baud rate. After the write of the new rate each unit is probed
+ * at the new and then at the old rate, so the result is known before anything is rolled back:
+ *  - answers at the new rate: moved
+ *  - answers at the old rate with the new rate in its register: applies after reset (MovePending), no rollback
+ *  - answers at the old rate with the old rate in its register: write refused, failed
+ *  - no answer at both rates: failed
+ * The move is all or nothing: if one unit fails, the units already moved are set back to their old rates.
+ * The baud rate of the own UART is changed via a callback, because Stream does not provide it.
+ * The class works non blocking with task(), the xy6020l instances on the same serial port must not run meanwhile.
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xy6020l_bus_h
+#define xy6020l_bus_h
+
+#include "Arduino.h"
+#include "xy6020l.h"
+
+#define XY_BUS_MAX_UNITS 8
+/** @brief all baud rate numbers for Scan() */
+#define XY_BUS_ALL_BAUDS 0x01FF
+
+/** @brief callback to set the baud rate of the UART, i.e. Serial1.begin(baud) */
+typedef void (*tSetBaudCallback)(unsigned long baud);
+
+/** @brief discovered unit */
+typedef struct {
+    byte Adr;
+    /** @brief baud rate number, see tXyBaudrate */
+    byte Baud;
+    word Model;
+    word Version;
+    /** @brief true if the last baud rate change of this unit failed */
+    bool MoveFailed;
+    /** @brief new rate written, the unit still answers at Baud: it applies the new one after a reset */
+    bool MovePending;
+    /** @brief the address answered at more than one baud rate: two units with the same address */
+    bool Conflict;
+} tXyUnit;
+
+/**
+ * @class xyBus
+ * @brief Discovery and baud rate negotiation of the units on one serial port
+ */
+class xyBus
+{
+  public:
+    /**
+     * @param serial Stream object reference (i.e., Serial1)
+     * @param setBaud callback to change the baud rate of serial
+     * @param txPeriod minimum period between 2 tx messages, in ms
+     * @param pClock time base, nullptr: Arduino millis()/micros()
+     */
+    xyBus(Stream& serial, tSetBaudCallback setBaud, byte txPeriod=50, xyClock* pClock=nullptr);
+
+    /**
+     * @brief starts the scan, results via getNbUnits()/getUnit() after task() returned false.
+     *        An address which answers at another rate again is listed once, with Conflict set.
+     * @param adrFirst first slave address
+     * @param adrLast last slave address
+     * @param baudMask bit n set: scan with baud rate number n
+     * @return false if busy
+     */
+    bool Scan(byte adrFirst=1, byte adrLast=247, word baudMask=XY_BUS_ALL_BAUDS);
+    /**
+     * @brief starts moving all found units to baud rate, each one is probed at the new and the old rate afterwards.
+     *        If a unit fails (MoveFailed), the units moved before are moved back to their old rates,
+     *        so the bus does not end up at mixed rates (except a unit which does not answer at all any more).
+     *        A unit which applies the rate after a reset (MovePending) is no failure, it answers at its old rate till then.
+     * @return false if busy, rate unsupported or a unit has an address conflict
+     */
+    bool MoveAll(tXyBaudrate baud);
+    /** @brief Task method that must be called in loop() cyclically, returns true while busy */
+    bool task(void);
+    bool IsBusy(void) { return mState != Idle; };
+
+    byte getNbUnits(void) { return mNbUnits; };
+    tXyUnit* getUnit(byte idx) { return idx < mNbUnits ? &mUnits[idx] : nullptr; };
+    /**
+     * @brief baud rate number the UART is set to: while scanning the scanned rate,
+     *        after MoveAll() the rate of the first unit without MovePending (the new rate if no unit failed),
+     *        the old rate if all units wait for a reset
+     */
+    tXyBaudrate getBaud(void) { return (tXyBaudrate)mBaud; };
+
+    /** @brief answer time of the XY6020L in addition to the frame time, in ms */
+    void setTurnaround(byte ms) { mTurnaround = ms; };
+
+  private:
+    enum          State { Idle, ScanTx, ScanRx, MoveTx, MoveRx, ProbeTx, ProbeRx };
+    State         mState;
+    Stream*       mSerial;
+    xyClock*      mClock;
+    tSetBaudCallback mSetBaud;
+    byte          mTxPeriod;
+    byte          mTurnaround;
+
+    tXyUnit       mUnits[XY_BUS_MAX_UNITS];
+    byte          mNbUnits;
+
+    // scan
+    byte          mAdr;
+    byte          mAdrFirst;
+    byte          mAdrLast;
+    word          mBaudMask;
+    byte          mBaud;
+    // move
+    byte          mUnitIdx;
+    byte          mNewBaud;
+    byte          mTries;
+    /** @brief probe at the target rate, false: at the rate before the write */
+    bool          mProbeNew;
+    /** @brief rates before MoveAll(), target of the units while moving back */
+    byte          mOldBaud[XY_BUS_MAX_UNITS];
+    bool          mRevert;
+
+    /** @brief tx time and answer timeout of the last frame, in us */
+    uint32_t      mTLastTx;
+    uint32_t      mTO;
+    byte          mRxBufIdx;
+    unsigned char mRxBuf[16];
+    unsigned char mTxBuf[8];
+
+    void SetBaud(byte baud);
+    bool NextScanBaud(void);
+    void SendFrame(byte adr, byte fct, word reg, word value, byte rxBytes);
+    /** @brief 1: valid answer, 0: waiting, -1: timeout */
+    int  RxFrame(byte rxBytes);
+    void MoveNextUnit(void);
+    /** @brief probes the actual unit at its target rate (newRate) or at the rate before */
+    void StartProbe(bool newRate);
+    /** @brief rate the actual unit is moved to */
+    byte MoveTarget(void) { return mRevert ? mOldBaud[mUnitIdx] : mNewBaud; };
+};
+#endif
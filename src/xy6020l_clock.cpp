@@ -0,0 +1,32 @@
+/**
+ * @file xy6020l_clock.cpp
+ * @brief Time base of the xy6020l driver and its companion classes
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#include "Arduino.h"
+#include "xy6020l_clock.h"
+
+uint32_t xyClock::micros(void)
+{
+  return (uint32_t)::micros();
+}
+
+uint32_t xyClock::millis(void)
+{
+  return (uint32_t)::millis();
+}
+
+void xyClock::delayMicroseconds(unsigned int us)
+{
+  ::delayMicroseconds(us);
+}
+
+xyClock& xyClock::Default(void)
+{
+  static xyClock clock;
+  return clock;
+}
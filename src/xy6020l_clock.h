@@ -0,0 +1,67 @@
+/**
+ * @file xy6020l_clock.h
+ * @brief Time base of the xy6020l driver and its companion classes
+ *
+ * All timing decisions (tx pause, answer timeout, rx pacing, round trip time, watchdog poll) use a xyClock,
+ * by default the Arduino millis()/micros()/delayMicroseconds().
+ * A xyVirtualClock replaces it in simulations, replays and benchmarks: time only moves on advance()
+ * or by the delays of the driver, so hours of bus traffic run in seconds with deterministic results.
+ *
+ * Time stamps are 32 bit on all platforms, so host builds wrap around like the MCU.
+ * Compare them only as difference: see xyClock::Elapsed().
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xy6020l_clock_h
+#define xy6020l_clock_h
+
+#include "Arduino.h"
+
+/**
+ * @class xyClock
+ * @brief Arduino time base, derive from it for other time sources
+ */
+class xyClock
+{
+  public:
+    virtual ~xyClock() {}
+    /** @brief time in us, wraps after 71 minutes */
+    virtual uint32_t micros(void);
+    /** @brief time in ms, wraps after 49 days */
+    virtual uint32_t millis(void);
+    /** @brief busy wait, in us */
+    virtual void delayMicroseconds(unsigned int us);
+
+    /** @brief wrap safe check if period passed from time stamp t to now */
+    static bool Elapsed(uint32_t now, uint32_t t, uint32_t period) { return (uint32_t)(now - t) >= period; };
+    /** @brief wrap safe check if deadline is reached, for deadlines less than half the wrap period ahead */
+    static bool Reached(uint32_t now, uint32_t deadline) { return (int32_t)(now - deadline) >= 0; };
+    /** @brief shared instance of the Arduino time base */
+    static xyClock& Default(void);
+};
+
+/**
+ * @class xyVirtualClock
+ * @brief Simulated time base, moves only with advance() and the delays of its users
+ */
+class xyVirtualClock : public xyClock
+{
+  public:
+    /** @param startUs start time, i.e. shortly before 2^32 us to test the wrap around of micros() */
+    xyVirtualClock(unsigned long long startUs=0) { mUs = startUs; };
+    uint32_t micros(void) { return (uint32_t)mUs; };
+    uint32_t millis(void) { return (uint32_t)(mUs / 1000); };
+    void delayMicroseconds(unsigned int us) { mUs += us; };
+
+    void advance(unsigned long us) { mUs += us; };
+    /** @brief time since start without wrap around, in us */
+    unsigned long long get(void) { return mUs; };
+    void set(unsigned long long us) { mUs = us; };
+
+  private:
+    unsigned long long mUs;
+};
+#endif
@@ -0,0 +1,187 @@
+/**
+ * @file xy6020l_energy.cpp
+ * @brief Charge and energy integration for the XY6020L DCDC
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#include "Arduino.h"
+#include "xy6020l_energy.h"
+
+/** @brief scaling of the 2 x integrals to Ah:  2 * 100 * 3600000 */
+#define ENERGY_Q2_PER_AH 7.2e8
+/** @brief scaling of the 2 x integrals to Wh:  2 * 10000 * 3600000 */
+#define ENERGY_E2_PER_WH 7.2e10
+/** @brief LSB of the device counters in Ah / Wh */
+#define ENERGY_DEV_LSB 0.001
+
+xyEnergy::xyEnergy(xy6020l& xy)
+{
+  mXy = &xy;
+  Reset();
+}
+
+void xyEnergy::Reset(void)
+{
+  mValid = false;
+  mDevValid = false;
+  mQ2 = 0;
+  mQErr2 = 0;
+  mE2 = 0;
+  mEErr2 = 0;
+  mDevQ = 0;
+  mDevE = 0;
+  mDevQGap = 0;
+  mDevEGap = 0;
+  mCntResets = 0;
+}
+
+/** @brief counter increment, a smaller value than before is taken as reset of the counter to 0 */
+unsigned long xyEnergy::CntDelta(unsigned long raw, unsigned long last, word& cntResets)
+{
+  if( raw >= last )
+    return raw - last;
+  cntResets++;
+  return raw;
+}
+
+void xyEnergy::Update(void)
+{
+  uint32_t ts, dt;
+  word v, i;
+  bool on;
+  long p0, p1;
+  long long dQ2 = 0, dQErr2 = 0, dE2 = 0, dEErr2 = 0;
+  unsigned long qRaw, eRaw;
+  word dummy = 0;
+
+  ts = mXy->getRxTime();
+  // no new sample
+  if( mValid && ts == mTs )
+    return;
+
+  v  = mXy->getActV();
+  i  = mXy->getActC();
+  on = mXy->getOutputOn();
+
+  if( mValid )
+  {
+    dt = ts - mTs;
+    p0 = (long)mV * mI;
+    p1 = (long)v * i;
+    if( mOn && on )
+    {
+      // trapezoid, error: linear course vs. step at any time plus LSB/2 quantization of each value
+      dQ2    = (long long)(mI + i) * dt;
+      dQErr2 = (long long)( (i > mI ? i - mI : mI - i) + 1 ) * dt;
+      dE2    = (long long)(p0 + p1) * dt;
+      dEErr2 = (long long)( (p1 > p0 ? p1 - p0 : p0 - p1) + (v > mV ? v : mV) + (i > mI ? i : mI) ) * dt;
+    }
+    else if( mOn || on )
+    {
+      // output switched within dt at unknown time: half interval with the current of the on sample +- half interval
+      if( on )
+      {
+        dQ2 = dQErr2 = (long long)i * dt;
+        dE2 = dEErr2 = (long long)p1 * dt;
+      }
+      else
+      {
+        dQ2 = dQErr2 = (long long)mI * dt;
+        dE2 = dEErr2 = (long long)p0 * dt;
+      }
+    }
+    mQ2    += dQ2;
+    mQErr2 += dQErr2;
+    mE2    += dE2;
+    mEErr2 += dEErr2;
+  }
+
+  // device counters
+  qRaw = mXy->getCharge();
+  eRaw = mXy->getEnergy();
+  if( mDevValid )
+  {
+    // the increments between the last read and a reset are lost: the counter delta is a lower bound only,
+    // the upper bound grows by the integrated interval plus the counter fraction lost with the reset
+    if( qRaw < mDevQRaw )
+      mDevQGap += GapLsb(dQ2 + dQErr2, ENERGY_Q2_PER_AH);
+    if( eRaw < mDevERaw )
+      mDevEGap += GapLsb(dE2 + dEErr2, ENERGY_E2_PER_WH);
+    mDevQ += CntDelta(qRaw, mDevQRaw, mCntResets);
+    // same reset counted once only
+    mDevE += CntDelta(eRaw, mDevERaw, dummy);
+  }
+  mDevQRaw = qRaw;
+  mDevERaw = eRaw;
+  mDevValid = true;
+
+  mTs = ts;
+  mV  = v;
+  mI  = i;
+  mOn = on;
+  mValid = true;
+}
+
+/** @brief upper bound of a 2 x interval integral in counter LSB rounded up, plus 1 LSB for the lost fraction */
+unsigned long xyEnergy::GapLsb(long long integ2, float perUnit)
+{
+  return (unsigned long)(integ2 / (perUnit * ENERGY_DEV_LSB)) + 2;
+}
+
+/**
+ * @brief fusion of integration and device counter
+ * The device counter delta has +-1 LSB quantization error (start and end value) and devGap more on the upper side
+ * after counter resets. The result is the center of the intersection of both error intervals. Without intersection the counter wins.
+ */
+void xyEnergy::Fuse(float integ, float integErr, float dev, float devGap, bool devValid, float& res, float& resErr)
+{
+  float lo, hi;
+
+  res = integ;
+  resErr = integErr;
+  if( devValid )
+  {
+    lo = integ - integErr;
+    hi = integ + integErr;
+    if( lo < dev - ENERGY_DEV_LSB ) lo = dev - ENERGY_DEV_LSB;
+    if( hi > dev + ENERGY_DEV_LSB + devGap ) hi = dev + ENERGY_DEV_LSB + devGap;
+    if( lo > hi )
+    {
+      lo = dev - ENERGY_DEV_LSB;
+      hi = dev + ENERGY_DEV_LSB + devGap;
+    }
+    res = (lo + hi) / 2;
+    resErr = (hi - lo) / 2;
+  }
+}
+
+float xyEnergy::getAh(void)
+{
+  float res, err;
+  Fuse( mQ2 / ENERGY_Q2_PER_AH, mQErr2 / ENERGY_Q2_PER_AH, mDevQ * ENERGY_DEV_LSB, mDevQGap * ENERGY_DEV_LSB, mDevValid, res, err);
+  return res;
+}
+
+float xyEnergy::getAhErr(void)
+{
+  float res, err;
+  Fuse( mQ2 / ENERGY_Q2_PER_AH, mQErr2 / ENERGY_Q2_PER_AH, mDevQ * ENERGY_DEV_LSB, mDevQGap * ENERGY_DEV_LSB, mDevValid, res, err);
+  return err;
+}
+
+float xyEnergy::getWh(void)
+{
+  float res, err;
+  Fuse( mE2 / ENERGY_E2_PER_WH, mEErr2 / ENERGY_E2_PER_WH, mDevE * ENERGY_DEV_LSB, mDevEGap * ENERGY_DEV_LSB, mDevValid, res, err);
+  return res;
+}
+
+float xyEnergy::getWhErr(void)
+{
+  float res, err;
+  Fuse( mE2 / ENERGY_E2_PER_WH, mEErr2 / ENERGY_E2_PER_WH, mDevE * ENERGY_DEV_LSB, mDevEGap * ENERGY_DEV_LSB, mDevValid, res, err);
+  return err;
+}
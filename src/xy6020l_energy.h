@@ -0,0 +1,78 @@
+/**
+ * @file xy6020l_energy.h
+ * @brief Charge and energy integration for the XY6020L DCDC
+ *
+ * Combines the 32 bit charge/energy counters of the XY6020L (LSB 0.001 Ah / 0.001 Wh)
+ * with a trapezoidal integration of the time stamped ACT_V/ACT_C samples.
+ * Both results are fused to the intersection of their error intervals,
+ * so short cycles get the resolution of the samples and long runs the stability of the counters.
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xy6020l_energy_h
+#define xy6020l_energy_h
+
+#include "Arduino.h"
+#include "xy6020l.h"
+
+/**
+ * @class xyEnergy
+ * @brief Driver side charge/energy integrator
+ */
+class xyEnergy
+{
+  public:
+    xyEnergy(xy6020l& xy);
+    /** @brief restarts the integration at 0 */
+    void Reset(void);
+    /** @brief takes over the latest HReg sample, call it after xy6020l::HRegUpdated() returned true */
+    void Update(void);
+
+    /** @brief charge since reset in Ah */
+    float getAh(void);
+    /** @brief error bound of getAh(), in Ah */
+    float getAhErr(void);
+    /** @brief energy since reset in Wh */
+    float getWh(void);
+    /** @brief error bound of getWh(), in Wh */
+    float getWhErr(void);
+
+    /** @brief number of detected counter resets of the XY6020L */
+    word getCntResets(void) { return mCntResets; };
+
+  private:
+    xy6020l*      mXy;
+
+    /** @brief previous sample */
+    bool          mValid;
+    uint32_t      mTs;
+    word          mV;
+    word          mI;
+    bool          mOn;
+
+    /** @brief 2 x integral in 0.01 A * ms  */
+    long long     mQ2;
+    long long     mQErr2;
+    /** @brief 2 x integral in 0.0001 W * ms  */
+    long long     mE2;
+    long long     mEErr2;
+
+    /** @brief device counters: last raw value and summed up deltas, LSB 0.001 Ah/Wh */
+    bool          mDevValid;
+    unsigned long mDevQRaw;
+    unsigned long mDevERaw;
+    unsigned long mDevQ;
+    unsigned long mDevE;
+    /** @brief upper bound of the increments lost with counter resets, LSB 0.001 Ah/Wh */
+    unsigned long mDevQGap;
+    unsigned long mDevEGap;
+    word          mCntResets;
+
+    static unsigned long CntDelta(unsigned long raw, unsigned long last, word& cntResets);
+    static unsigned long GapLsb(long long integ2, float perUnit);
+    static void Fuse(float integ, float integErr, float dev, float devGap, bool devValid, float& res, float& resErr);
+};
+#endif
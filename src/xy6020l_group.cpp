@@ -0,0 +1,160 @@
+/**
+ * @file xy6020l_group.cpp
+ * @brief Synchronized setpoints for a group of XY6020L converters on one bus
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#include "Arduino.h"
+#include "xy6020l_group.h"
+
+xyGroup::xyGroup(word timeout)
+{
+  mState = Idle;
+  mNbUnits = 0;
+  mTimeout = timeout;
+  mNbConfirmed = 0;
+  mNbFallback = 0;
+  mNbFailed = 0;
+  mSkew = 0;
+  mConfirmTime = 0;
+}
+
+bool xyGroup::add(xy6020l& xy)
+{
+  bool retVal=false;
+  if( mNbUnits < XY_GROUP_MAX_UNITS && mState == Idle )
+  {
+    mpUnits[mNbUnits++] = &xy;
+    retVal = true;
+  }
+  return retVal;
+}
+
+bool xyGroup::Write(byte hRegIdx, word value)
+{
+  bool retVal=false;
+  if( mState == Idle && mNbUnits > 0 && hRegIdx < NB_HREGS )
+  {
+    mHRegIdx = hRegIdx;
+    mValue = value;
+    mConfirmTime = 0;
+    mState = Send;
+    retVal = true;
+  }
+  return retVal;
+}
+
+bool xyGroup::IsConfirmed(byte idx, uint32_t t)
+{
+  xy6020l* pXy = mpUnits[idx];
+  return ( (int32_t)(pXy->getRxTime() - t) > 0 ) && ( pXy->getHReg(mHRegIdx) == mValue );
+}
+
+void xyGroup::Finish(void)
+{
+  byte i;
+  uint32_t tMin=0, tMax=0;
+  bool first = true;
+
+  mNbConfirmed = 0;
+  mNbFallback = 0;
+  mNbFailed = 0;
+  for(i=0; i < mNbUnits; i++)
+  {
+    switch( mUnitState[i] )
+    {
+      case Confirmed: mNbConfirmed++; break;
+      case Done:      mNbFallback++; break;
+      default:        mNbFailed++; continue;
+    }
+    if( first || (int32_t)(mTApplied[i] - tMin) < 0 )
+      tMin = mTApplied[i];
+    if( first || (int32_t)(mTApplied[i] - tMax) > 0 )
+      tMax = mTApplied[i];
+    first = false;
+  }
+  mSkew = (word)(tMax - tMin);
+  mState = Idle;
+}
+
+bool xyGroup::task(void)
+{
+  byte i;
+  bool done = true;
+  uint32_t now;
+
+  if( mState == Idle )
+    return false;
+  // all units share the bus and its time base
+  now = mpUnits[0]->getClock().millis();
+
+  switch( mState )
+  {
+    case Idle:
+      break;
+
+    case Send:
+      // all units share one port: sent as soon as the open request is answered, the port starts no new one meanwhile
+      if( mpUnits[0]->SendBroadcast(mHRegIdx, mValue) )
+      {
+        mTBroadcast = mpUnits[0]->getClock().millis();
+        for(i=0; i < mNbUnits; i++)
+        {
+          mUnitState[i] = Pending;
+          mReadReq[i] = false;
+        }
+        mState = Wait;
+      }
+      break;
+
+    case Wait:
+      for(i=0; i < mNbUnits; i++)
+      {
+        switch( mUnitState[i] )
+        {
+          case Pending:
+            if( IsConfirmed(i, mTBroadcast) )
+            {
+              mUnitState[i] = Confirmed;
+              mTApplied[i] = mpUnits[i]->getRxTime();
+              mConfirmTime = (word)(now - mTBroadcast);
+            }
+            else if( now - mTBroadcast > mTimeout )
+            {
+              // fallback: single write ahead of the queued writes and the HReg update of the unit
+              if( mpUnits[i]->QueueHRegPrio(mHRegIdx, mValue) )
+              {
+                mUnitState[i] = Fallback;
+                mTApplied[i] = now;
+                mReadReq[i] = false;
+              }
+            }
+            break;
+          case Fallback:
+            if( IsConfirmed(i, mTApplied[i]) )
+            {
+              mUnitState[i] = Done;
+              mTApplied[i] = mpUnits[i]->getRxTime();
+              mConfirmTime = (word)(now - mTBroadcast);
+            }
+            else if( now - mTApplied[i] > mTimeout )
+              mUnitState[i] = Failed;
+            break;
+          default:
+            break;
+        }
+        // confirmation needs a read of the HRegs
+        if( (mUnitState[i] == Pending || mUnitState[i] == Fallback) && mpUnits[i]->isNoHRegUpdate() && !mReadReq[i] )
+          mReadReq[i] = mpUnits[i]->ReadAllHRegs();
+        if( mUnitState[i] == Pending || mUnitState[i] == Fallback )
+          done = false;
+      }
+      if( done )
+        Finish();
+      break;
+  }
+  return mState != Idle;
+}
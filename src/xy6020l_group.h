@@ -0,0 +1,91 @@
+/**
+ * @file xy6020l_group.h
+ * @brief Synchronized setpoints for a group of XY6020L converters on one bus
+ *
+ * A group write reaches all units with 1 ModBus broadcast frame (slave address 0, no answer) at the same time,
+ * instead of 1 round trip + tx period per unit. Each unit is confirmed by the next read of its holding registers.
+ * A unit without confirmation within the timeout gets the value with a single write as fallback, sent with its next
+ * tx slot ahead of its queued writes (xy6020l::QueueHRegPrio()).
+ * All units of a group must be constructed on the same xyPort.
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xy6020l_group_h
+#define xy6020l_group_h
+
+#include "Arduino.h"
+#include "xy6020l.h"
+
+#define XY_GROUP_MAX_UNITS 8
+
+/**
+ * @class xyGroup
+ * @brief Group of xy6020l instances sharing the same xyPort
+ */
+class xyGroup
+{
+  public:
+    /** @param timeout time for confirmation of a unit, in ms, then fallback write / failure */
+    xyGroup(word timeout=500);
+    /** @brief adds a unit, false if group is full */
+    bool add(xy6020l& xy);
+
+    /** @brief starts a group write, false if the previous one is not finished */
+    bool Write(byte hRegIdx, word value);
+    bool setCV(word cv) { return Write(HREG_IDX_CV, cv); };
+    bool setCC(word cc) { return Write(HREG_IDX_CC, cc); };
+    bool setOutput(bool onState) { return Write(HREG_IDX_OUTPUT_ON, onState?1:0); };
+
+    /** @brief Task method that must be called in loop() after the task() of all units, true while a write is in progress */
+    bool task(void);
+    bool IsBusy(void) { return mState != Idle; };
+
+    /// @name result of the last group write
+    /// @{
+    /** @brief units confirmed after the broadcast */
+    byte getNbConfirmed(void) { return mNbConfirmed; };
+    /** @brief units which needed the fallback write */
+    byte getNbFallback(void) { return mNbFallback; };
+    /** @brief units not confirmed at all */
+    byte getNbFailed(void) { return mNbFailed; };
+    /**
+     * @brief spread of the confirmation times of the units, in ms: time stamp of the HReg read answer of each unit
+     *        which showed the value first. The units take turns on the bus, so it includes the poll order
+     *        (about 1 read period for several units) and is an upper limit of the spread of the real takeover.
+     */
+    word getSkew(void) { return mSkew; };
+    /** @brief time from broadcast to the last confirmation, in ms */
+    word getConfirmTime(void) { return mConfirmTime; };
+    /// @}
+
+  private:
+    enum          State { Idle, Send, Wait };
+    enum          UnitState { Pending, Confirmed, Fallback, Done, Failed };
+    State         mState;
+    xy6020l*      mpUnits[XY_GROUP_MAX_UNITS];
+    UnitState     mUnitState[XY_GROUP_MAX_UNITS];
+    /** @brief confirmation time of the unit, in ms; in state Fallback the time of the fallback write */
+    uint32_t      mTApplied[XY_GROUP_MAX_UNITS];
+    /** @brief read request sent for units without automatic HReg update */
+    bool          mReadReq[XY_GROUP_MAX_UNITS];
+    byte          mNbUnits;
+    word          mTimeout;
+
+    byte          mHRegIdx;
+    word          mValue;
+    uint32_t      mTBroadcast;
+
+    byte          mNbConfirmed;
+    byte          mNbFallback;
+    byte          mNbFailed;
+    word          mSkew;
+    word          mConfirmTime;
+
+    /** @brief true if the unit answered a read requested after time t with the group value */
+    bool IsConfirmed(byte idx, uint32_t t);
+    void Finish(void);
+};
+#endif
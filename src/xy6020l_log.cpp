@@ -0,0 +1,102 @@
+/**
+ * @file xy6020l_log.cpp
+ * @brief Compact streaming log of the holding registers
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#include "Arduino.h"
+#include "xy6020l_log.h"
+
+xyLogWriter::xyLogWriter(Print& out, byte keyInterval)
+{
+  mOut = &out;
+  mKeyInterval = keyInterval > 0 ? keyInterval : 1;
+  mCnt = 0;
+  mTPrev = 0;
+  mNbRecords = 0;
+  mNbBytes = 0;
+}
+
+void xyLogWriter::begin(void)
+{
+  WriteByte('X');
+  WriteByte('Y');
+  WriteByte('T');
+  WriteByte('L');
+  WriteByte(XY_LOG_VERSION);
+  WriteByte(NB_HREGS_READ);
+  mCnt = 0;
+}
+
+void xyLogWriter::WriteByte(byte value)
+{
+  mNbBytes += mOut->write(value);
+}
+
+void xyLogWriter::WriteVarint(unsigned long value)
+{
+  while( value >= 0x80 )
+  {
+    WriteByte( (value & 0x7F) | 0x80 );
+    value >>= 7;
+  }
+  WriteByte( value );
+}
+
+void xyLogWriter::add(uint32_t t, const word* pRegs)
+{
+  byte i;
+  unsigned long mask = 0;
+  int diff;
+
+  if( mCnt == 0 )
+  {
+    // keyframe
+    WriteByte(XY_LOG_KEY);
+    for(i=0; i < 4; i++)
+      WriteByte( (t >> (8*i)) & 0xFF );
+    for(i=0; i < NB_HREGS_READ; i++)
+      WriteVarint(pRegs[i]);
+  }
+  else
+  {
+    for(i=0; i < NB_HREGS_READ; i++)
+    {
+      if( pRegs[i] != mPrev[i] )
+        mask |= 1UL << i;
+    }
+    WriteByte(XY_LOG_DELTA);
+    WriteVarint(t - mTPrev);
+    WriteVarint(mask);
+    for(i=0; i < NB_HREGS_READ; i++)
+    {
+      if( mask & (1UL << i) )
+      {
+        // 16 bit difference, zigzag: small positive and negative steps in 1 byte
+        diff = (int16_t)(pRegs[i] - mPrev[i]);
+        WriteVarint( diff >= 0 ? ((unsigned long)diff << 1) : (((unsigned long)(-(long)diff) << 1) - 1) );
+      }
+    }
+  }
+  memcpy(mPrev, pRegs, sizeof(mPrev));
+  mTPrev = t;
+  mNbRecords++;
+  if( ++mCnt >= mKeyInterval )
+    mCnt = 0;
+}
+
+bool xyLogWriter::add(xy6020l& xy)
+{
+  word regs[NB_HREGS_READ];
+
+  // no new answer since the last record, i.e. HRegUpdated() after a timeout
+  if( !xy.HRegValid() || ( (mNbRecords > 0) && (xy.getRxTime() == mTPrev) ) )
+    return false;
+  for(byte i=0; i < NB_HREGS_READ; i++)
+    regs[i] = xy.getHReg(i);
+  add(xy.getRxTime(), regs);
+  return true;
+}
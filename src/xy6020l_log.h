@@ -0,0 +1,71 @@
+/**
+ * @file xy6020l_log.h
+ * @brief Compact streaming log of the holding registers
+ *
+ * Append only format for full HReg frames, written to any Print (SD card file, host file ...)
+ * without dynamic memory. Most registers barely change between frames, so each record holds only
+ * the changes against the previous frame:
+ *
+ *  - header:   "XYTL" + version byte + number of registers (NB_HREGS_READ: the polled ones, 0x1E is not read)
+ *  - keyframe: XY_LOG_KEY, time in ms (4 bytes, little endian), all registers as varint
+ *  - delta:    XY_LOG_DELTA, time since previous record in ms as varint, bitmask of changed registers as varint,
+ *              difference of each changed register as zigzag varint
+ *
+ * Keyframes are written periodically, they allow random access and a time index (see host reader xyLogReader).
+ * All varints are unsigned LEB128.
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xy6020l_log_h
+#define xy6020l_log_h
+
+#include "Arduino.h"
+#include "xy6020l.h"
+
+#define XY_LOG_VERSION 1
+#define XY_LOG_KEY 0x01
+#define XY_LOG_DELTA 0x02
+
+/**
+ * @class xyLogWriter
+ * @brief Incremental writer of the telemetry log
+ */
+class xyLogWriter
+{
+  public:
+    /**
+     * @param out destination of the log
+     * @param keyInterval number of records from one keyframe to the next
+     */
+    xyLogWriter(Print& out, byte keyInterval=64);
+    /** @brief writes the file header, call it once for a new file */
+    void begin(void);
+    /** @brief appends a frame of NB_HREGS_READ registers at time t in ms */
+    void add(uint32_t t, const word* pRegs);
+    /**
+     * @brief appends the actual register cache of the driver, time stamp of its last update
+     * @return false if skipped: no answer since the last record (same getRxTime()) or none at all yet
+     */
+    bool add(xy6020l& xy);
+    /** @brief next record is a keyframe, i.e. after reopening the file */
+    void forceKey(void) { mCnt = 0; };
+
+    unsigned long getNbRecords(void) { return mNbRecords; };
+    unsigned long getNbBytes(void) { return mNbBytes; };
+
+  private:
+    Print*        mOut;
+    byte          mKeyInterval;
+    byte          mCnt;
+    uint32_t      mTPrev;
+    word          mPrev[NB_HREGS_READ];
+    unsigned long mNbRecords;
+    unsigned long mNbBytes;
+
+    void WriteByte(byte value);
+    void WriteVarint(unsigned long value);
+};
+#endif
@@ -0,0 +1,205 @@
+/**
+ * @file xy6020l_profile.cpp
+ * @brief Setpoint profile generator for the XY6020L DCDC
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#include "Arduino.h"
+#include "xy6020l_profile.h"
+
+xyProfile::xyProfile(xy6020l& xy)
+{
+  mXy = &xy;
+  mpSegs = nullptr;
+  mNbSegs = 0;
+  mInFlash = false;
+  mRunning = false;
+  mSegIdx = 0;
+  mSlotPeriod = 0;
+  mTxPend = false;
+  mEmitted = 0;
+  mSkipped = 0;
+  mLastDrift = 0;
+  mMaxDrift = 0;
+}
+
+bool xyProfile::Start(const tProfileSeg* pSegs, byte nbSegs, bool inFlash, word startV)
+{
+  bool retVal=false;
+  if( pSegs != nullptr && nbSegs > 0 )
+  {
+    mpSegs = pSegs;
+    mNbSegs = nbSegs;
+    mInFlash = inFlash;
+    mVStart = startV>0 ? startV : mXy->getCV();
+    mSegIdx = 0;
+    mK = 0;
+    mPendFlags = 0;
+    mPendEntry = false;
+    mTxPend = false;
+    mEmitted = 0;
+    mSkipped = 0;
+    mLastDrift = 0;
+    mMaxDrift = 0;
+    LoadSeg(0);
+    mSlot = getSlotPeriod();
+    mSegStart = mXy->getClock().millis();
+    mRunning = true;
+    retVal = true;
+  }
+  return retVal;
+}
+
+word xyProfile::getSlotPeriod(void)
+{
+  word period = mSlotPeriod;
+  if( period == 0 )
+  {
+    // 1 frame: pause time + answer time, without answer yet assume the pause time again
+    period = mXy->getTxPeriod() + ( mXy->getRtt()>0 ? mXy->getRtt() : mXy->getTxPeriod() );
+    // leave every 2nd slot for the automatic HReg update
+    if( !mXy->isNoHRegUpdate() )
+      period *= 2;
+    if( period == 0 )
+      period = 1;
+  }
+  return period;
+}
+
+void xyProfile::LoadSeg(byte idx)
+{
+  if(mInFlash)
+    memcpy_P( &mSeg, &mpSegs[idx], sizeof(tProfileSeg));
+  else
+    mSeg = mpSegs[idx];
+
+  // collect segment start actions, a later segment overrides the former ones if they could not be sent
+  if( mSeg.Flags & XY_SEG_OUT_ON )
+    mPendFlags = (mPendFlags & ~XY_SEG_OUT_OFF) | XY_SEG_OUT_ON;
+  if( mSeg.Flags & XY_SEG_OUT_OFF )
+    mPendFlags = (mPendFlags & ~XY_SEG_OUT_ON) | XY_SEG_OUT_OFF;
+  if( mSeg.Flags & XY_SEG_SET_CC )
+  {
+    mPendFlags |= XY_SEG_SET_CC;
+    mPendCC = mSeg.CC;
+  }
+  mPendEntry = true;
+}
+
+/** @brief voltage setpoint of the active segment at time t after segment start */
+word xyProfile::getSegValue(unsigned long t)
+{
+  word v = mVStart;
+  // behind last segment -> end value
+  if( mSegIdx < mNbSegs )
+  {
+    switch( mSeg.Type )
+    {
+      case XY_SEG_STEP:
+        v = mSeg.V;
+        break;
+      case XY_SEG_RAMP:
+        if( t >= mSeg.Duration )
+          v = mSeg.V;
+        else
+          v = mVStart + (long)( ((float)mSeg.V - (float)mVStart) * (float)t / (float)mSeg.Duration );
+        break;
+      default:
+        break;
+    }
+  }
+  return v;
+}
+
+void xyProfile::Emit(word v, uint32_t deadline, uint32_t now)
+{
+  if( mPendFlags & XY_SEG_OUT_OFF )
+    mXy->setOutput(false);
+  if( mPendFlags & XY_SEG_SET_CC )
+    mXy->setCC(mPendCC);
+  mXy->setCV(v);
+  if( mPendFlags & XY_SEG_OUT_ON )
+    mXy->setOutput(true);
+  mPendFlags = 0;
+  mPendEntry = false;
+
+  // drift is measured when the driver sends the CV write
+  mTxPend = true;
+  mTxV = v;
+  mTxLag = now - deadline;
+  mTxEmit = mXy->getClock().micros();
+  mEmitted++;
+}
+
+/** @brief measures the drift of the pending setpoint as soon as its CV write is sent */
+void xyProfile::CheckDrift(void)
+{
+  const tXyTransaction& tx = mXy->getLastTx();
+  uint32_t drift;
+
+  if( mTxPend )
+  {
+    if( (tx.Fct == 0x06) && (tx.Start == HREG_IDX_CV) && (tx.Value == mTxV) && ((int32_t)(tx.TxTime - mTxEmit) >= 0) )
+    {
+      // target time to emit + emit to tx
+      drift = mTxLag + (tx.TxTime - mTxEmit) / 1000;
+      mLastDrift = drift > 0xFFFF ? 0xFFFF : (word)drift;
+      if( mLastDrift > mMaxDrift )
+        mMaxDrift = mLastDrift;
+      mTxPend = false;
+    }
+    // queue sent without the CV write: skipped as same value
+    else if( mXy->TxBufEmpty() )
+      mTxPend = false;
+  }
+}
+
+bool xyProfile::task(void)
+{
+  uint32_t now, elapsed;
+  unsigned long kNow;
+
+  CheckDrift();
+  if( mRunning )
+  {
+    now = mXy->getClock().millis();
+
+    // segment(s) finished ?
+    while( (mSegIdx < mNbSegs) && (now - mSegStart >= mSeg.Duration) )
+    {
+      mVStart = getSegValue(mSeg.Duration);
+      mSegStart += mSeg.Duration;
+      mSegIdx++;
+      mK = 0;
+      mSlot = getSlotPeriod();
+      if( mSegIdx < mNbSegs )
+        LoadSeg(mSegIdx);
+      else
+        // final setpoint
+        mPendEntry = true;
+    }
+
+    elapsed = now - mSegStart;
+    // segment start or next ramp point due ?
+    if( mPendEntry ||
+        ( (mSegIdx < mNbSegs) && (mSeg.Type == XY_SEG_RAMP) && (elapsed >= (unsigned long)mK * mSlot) ) )
+    {
+      // emit only into an empty driver queue, otherwise wait for the next deadline
+      if( mXy->TxBufEmpty() )
+      {
+        kNow = elapsed / mSlot;
+        if( kNow > mK )
+          mSkipped += kNow - mK;
+        Emit( getSegValue(kNow * mSlot), mSegStart + kNow * mSlot, now );
+        mK = kNow + 1;
+
+        if( mSegIdx >= mNbSegs )
+          mRunning = false;
+      }
+    }
+  }
+  return mRunning;
+}
@@ -0,0 +1,135 @@
+/**
+ * @file xy6020l_profile.h
+ * @brief Setpoint profile generator for the XY6020L DCDC
+ *
+ * Drives voltage/current profiles (ramps, holds, steps) out of a compact segment table.
+ * The setpoints are emitted on a deadline schedule derived from the free bus slots:
+ * intermediate points which do not fit on the bus are skipped instead of queued,
+ * the drift of every emitted point from its target time to the tx of its CV write on the bus is recorded.
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xy6020l_profile_h
+#define xy6020l_profile_h
+
+#include "Arduino.h"
+#include "xy6020l.h"
+
+/** @brief segment types */
+// linear ramp from the previous voltage to V within Duration
+#define XY_SEG_RAMP 0
+// keep the previous voltage for Duration, V is ignored
+#define XY_SEG_HOLD 1
+// set V at segment start and keep it for Duration
+#define XY_SEG_STEP 2
+
+/** @brief segment flags, applied at segment start */
+#define XY_SEG_OUT_ON 1
+#define XY_SEG_OUT_OFF 2
+// set the current limit CC
+#define XY_SEG_SET_CC 4
+
+/** @brief one profile segment, 10 bytes, can be placed in flash with PROGMEM */
+typedef struct {
+    byte Type;
+    byte Flags;
+    /** @brief target voltage, LSB: 0.01 V */
+    word V;
+    /** @brief current limit, LSB: 0.01 A, only used with XY_SEG_SET_CC */
+    word CC;
+    /** @brief segment duration in ms */
+    unsigned long Duration;
+} tProfileSeg;
+
+/**
+ * @class xyProfile
+ * @brief Deadline scheduled profile engine on top of a xy6020l driver
+ */
+class xyProfile
+{
+  public:
+    xyProfile(xy6020l& xy);
+    /**
+     * @brief starts a profile
+     * @param pSegs segment table, stays referenced while the profile runs
+     * @param nbSegs number of segments in table
+     * @param inFlash true if the table is stored with PROGMEM
+     * @param startV start voltage of a first ramp segment, 0: actual CV setpoint of the XY6020L
+     * @return false if table is empty
+     */
+    bool Start(const tProfileSeg* pSegs, byte nbSegs, bool inFlash=false, word startV=0);
+    /** @brief stops the profile, the last emitted setpoints stay active */
+    void Stop(void) { mRunning = false; };
+    /**
+     * @brief Task method that must be called in loop() function after the xy6020l::task()
+     * @return true as long as the profile runs
+     */
+    bool task(void);
+
+    bool IsRunning(void) { return mRunning; };
+    /** @brief index of the active segment */
+    byte getSegment(void) { return mSegIdx; };
+
+    /** @brief period between 2 setpoints, in ms, 0 = derived from tx period and round trip time */
+    void setSlotPeriod(word period) { mSlotPeriod = period; };
+    word getSlotPeriod(void);
+
+    /// @name deadline statistics
+    /// @{
+    /** @brief number of emitted setpoints */
+    unsigned long getEmitted(void) { return mEmitted; };
+    /** @brief number of skipped intermediate setpoints */
+    unsigned long getSkipped(void) { return mSkipped; };
+    /**
+     * @brief time from the target time of the last setpoint to the tx of its CV write by the driver, in ms
+     * Only measured if task() runs after each xy6020l::task(), setpoints not sent (same value with
+     * XY6020_OPT_SKIP_SAME_HREG_VALUE) keep the former drift.
+     */
+    word getLastDrift(void) { return mLastDrift; };
+    /** @brief maximum drift since start, in ms */
+    word getMaxDrift(void) { return mMaxDrift; };
+    /// @}
+
+  private:
+    xy6020l*           mXy;
+    const tProfileSeg* mpSegs;
+    byte               mNbSegs;
+    bool               mInFlash;
+    bool               mRunning;
+
+    byte               mSegIdx;
+    tProfileSeg        mSeg;
+    /** @brief voltage at start of the active segment */
+    word               mVStart;
+    uint32_t           mSegStart;
+    /** @brief index of the next deadline in the active segment */
+    unsigned long      mK;
+    word               mSlotPeriod;
+    /** @brief slot period latched at segment start, keeps the deadline grid fixed within a segment */
+    word               mSlot;
+
+    /** @brief segment start actions not emitted yet */
+    byte               mPendFlags;
+    word               mPendCC;
+    bool               mPendEntry;
+
+    /** @brief CV write of the last setpoint not seen on the bus yet: value, target time to emit in ms, emit time in us */
+    bool               mTxPend;
+    word               mTxV;
+    uint32_t           mTxLag;
+    uint32_t           mTxEmit;
+
+    unsigned long      mEmitted;
+    unsigned long      mSkipped;
+    word               mLastDrift;
+    word               mMaxDrift;
+
+    void LoadSeg(byte idx);
+    word getSegValue(unsigned long t);
+    void Emit(word v, uint32_t deadline, uint32_t now);
+    void CheckDrift(void);
+};
+#endif
@@ -0,0 +1,87 @@
+/**
+ * @file xy6020l_record.cpp
+ * @brief Recording of the bus traffic of a xy6020l driver
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#include "Arduino.h"
+#include "xy6020l_record.h"
+
+xyRecordStream::xyRecordStream(Stream& serial, Print& log, xyClock* pClock)
+{
+  mSerial = &serial;
+  mLog = &log;
+  mClock = pClock != nullptr ? pClock : &xyClock::Default();
+  mTLast = mClock->micros();
+  mNbRecords = 0;
+  mRxHead = 0;
+  mRxTail = 0;
+}
+
+void xyRecordStream::begin(void)
+{
+  mLog->write((const uint8_t*)"XYRC", 4);
+  mLog->write((uint8_t)XY_REC_VERSION);
+  mTLast = mClock->micros();
+}
+
+void xyRecordStream::WriteVarint(unsigned long value)
+{
+  while( value >= 0x80 )
+  {
+    mLog->write((uint8_t)( (value & 0x7F) | 0x80 ));
+    value >>= 7;
+  }
+  mLog->write((uint8_t)value);
+}
+
+void xyRecordStream::Record(byte tag, const uint8_t* pBuf, size_t size)
+{
+  uint32_t now = mClock->micros();
+
+  mLog->write(tag);
+  WriteVarint(now - mTLast);
+  WriteVarint(size);
+  mLog->write(pBuf, size);
+  mTLast = now;
+  mNbRecords++;
+}
+
+int xyRecordStream::available(void)
+{
+  byte start;
+
+  // take over all bytes arrived till now as 1 burst
+  if( mRxHead == mRxTail )
+    mRxHead = mRxTail = 0;
+  start = mRxTail;
+  while( (mSerial->available() > 0) && (mRxTail < XY_REC_RX_BUFFER_SIZE) )
+    mRxBuf[mRxTail++] = mSerial->read();
+  if( mRxTail > start )
+    Record(XY_REC_RX, &mRxBuf[start], mRxTail - start);
+
+  return mRxTail - mRxHead;
+}
+
+int xyRecordStream::read(void)
+{
+  if( available() <= 0 )
+    return -1;
+  return mRxBuf[mRxHead++];
+}
+
+int xyRecordStream::peek(void)
+{
+  if( available() <= 0 )
+    return -1;
+  return mRxBuf[mRxHead];
+}
+
+size_t xyRecordStream::write(const uint8_t* pBuf, size_t size)
+{
+  Record(XY_REC_TX, pBuf, size);
+  return mSerial->write(pBuf, size);
+}
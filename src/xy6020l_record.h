@@ -0,0 +1,65 @@
+/**
+ * @file xy6020l_record.h
+ * @brief Recording of the bus traffic of a xy6020l driver
+ *
+ * xyRecordStream is placed between the driver and its serial port and logs the time stamped TX and RX
+ * byte bursts to any Print (SD card file, host file ...). RX bytes are recorded as they become visible to the driver,
+ * so a replay reproduces exactly the byte arrival seen by task().
+ *
+ * File format, all numbers as unsigned LEB128 varint:
+ *  - header: "XYRC" + version byte
+ *  - record: tag (XY_REC_TX / XY_REC_RX), time since previous record in us, number of bytes, bytes
+ *
+ * @author Jens Gleissberg
+ * @date 2024
+ * @license GNU Lesser General Public License v3.0 or later
+ */
+
+#ifndef xy6020l_record_h
+#define xy6020l_record_h
+
+#include "Arduino.h"
+#include "xy6020l_clock.h"
+
+#define XY_REC_VERSION 1
+#define XY_REC_TX 0x01
+#define XY_REC_RX 0x02
+#define XY_REC_RX_BUFFER_SIZE 64
+
+/**
+ * @class xyRecordStream
+ * @brief Stream wrapper recording all traffic, i.e.  xyRecordStream rec(Serial1, logFile); xy6020l xy(rec);
+ */
+class xyRecordStream : public Stream
+{
+  public:
+    /** @param pClock time base of the time stamps, should be the one of the driver, nullptr: Arduino micros() */
+    xyRecordStream(Stream& serial, Print& log, xyClock* pClock=nullptr);
+    /** @brief writes the file header, must be called before the first traffic */
+    void begin(void);
+
+    int available(void);
+    int read(void);
+    int peek(void);
+    size_t write(uint8_t c) { return write(&c, 1); };
+    size_t write(const uint8_t* pBuf, size_t size);
+    using Print::write;
+    void flush(void) { mSerial->flush(); mLog->flush(); };
+
+    unsigned long getNbRecords(void) { return mNbRecords; };
+
+  private:
+    Stream*       mSerial;
+    Print*        mLog;
+    xyClock*      mClock;
+    uint32_t      mTLast;
+    unsigned long mNbRecords;
+    /** @brief bytes taken from the serial port, not read by the driver yet */
+    unsigned char mRxBuf[XY_REC_RX_BUFFER_SIZE];
+    byte          mRxHead;
+    byte          mRxTail;
+
+    void Record(byte tag, const uint8_t* pBuf, size_t size);
+    void WriteVarint(unsigned long value);
+};
+#endif